@@ -208,8 +208,10 @@ class ObstacleMap {
       rs::LeafNodeEntry leaf(mbr, (rs::Data_P)(&mesh->mesh_polygons.at(i)));
       traversableEntries.push_back(leaf);
     }
+    rs::Entry_P_V entryPtrs;
     for (auto& it: traversableEntries)
-      traversableRtree->insertData(&it);
+      entryPtrs.push_back(&it);
+    traversableRtree->bulkLoad(entryPtrs);
   }
 
   void initRtree() {
@@ -227,8 +229,10 @@ class ObstacleMap {
       rs::LeafNodeEntry leaf(genSegMbr(perimeters[i].first, perimeters[i].second), (rs::Data_P)(&perimeters[i]));
       rtEntries.push_back(leaf);
     }
+    rs::Entry_P_V entryPtrs;
     for (auto& it: rtEntries)
-      rtree->insertData(&it);
+      entryPtrs.push_back(&it);
+    rtree->bulkLoad(entryPtrs);
   }
 
   bool isVisible(const Seg& seg) {
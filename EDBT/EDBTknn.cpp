@@ -231,7 +231,7 @@ vector<pair<pPtr, double>> EDBTkNN::Euclidean_NN(int k) {
   heap.clear();
   double d;
   rs::Point rq(q.x, q.y);
-  d = sqrt(rs::RStarTreeUtil::dis2(rq, rte->root->mbrn));
+  d = rs::RStarTreeUtil::dis2(rq, rte->root->mbrn);
   heap.push(rs::MinHeapEntry(d, rte->root));
   vector<pair<pPtr, double> > res;
   for (int i=0; i<k; i++) {
@@ -129,8 +129,10 @@ public:
       rs::LeafNodeEntry leaf(mbr, (rs::Data_P)&it);
       rtEntries.push_back(leaf);
     }
+    rs::Entry_P_V entryPtrs;
     for (auto& it: rtEntries)
-      rte->insertData(&it);
+      entryPtrs.push_back(&it);
+    rte->bulkLoad(entryPtrs);
   }
 
   double ODC(Graph& g, pPtr p, double& curR);
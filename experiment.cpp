@@ -4,6 +4,8 @@
 #include "intervaHeuristic.h"
 #include "fenceHeuristic.h"
 #include "searchinstance.h"
+#include "parallelsearch.h"
+#include "knnbatch.h"
 #include "genPoints.h"
 #include "knnMeshFence.h"
 #include "mesh.h"
@@ -322,7 +324,7 @@ void nn_experiment(pl::Point start, vector<string>& cols, bool verbose=false) {
   double cost_fc = 0;
   fi->set_start(start);
   fi->set_goals(pts);
-  fi->nn_query(si, cost_fc);
+  fi->nn_query(cost_fc);
   row["cost_fc"] = cost_fc;
   row["gen_fc"] = fi->nodes_generated;
 
@@ -529,6 +531,622 @@ void print_header(const vector<string>& cols) {
   }
 }
 
+void distance_only_experiment(pl::Point start, int k, const vector<string>& cols) {
+  // run each engine with and without paths, results must not change
+  int mismatch = 0;
+  map<string, double> row;
+  auto run = [&](string name, bool distance_only) {
+    vector<double> dists;
+    if (name == "ki") {
+      ki->set_distance_only(distance_only);
+      ki->set_K(k);
+      ki->set_start_goal(start, pts);
+      int actual = ki->search();
+      for (int i=0; i<actual; i++) dists.push_back(ki->get_cost(i));
+      row["gen_" + name] = ki->nodes_generated;
+      row[(distance_only? "dlive_": "live_") + name] = ki->get_peak_live();
+    }
+    else if (name == "hi") {
+      hi->set_distance_only(distance_only);
+      hi->set_K(k);
+      hi->set_start(start);
+      int actual = hi->search();
+      for (int i=0; i<actual; i++) dists.push_back(hi->get_cost(i));
+      row["gen_" + name] = hi->nodes_generated;
+      row[(distance_only? "dlive_": "live_") + name] = hi->get_peak_live();
+    }
+    else {
+      fi->set_distance_only(distance_only);
+      fi->set_K(k);
+      fi->set_start(start);
+      int actual = fi->search();
+      for (int i=0; i<actual; i++) dists.push_back(fi->get_cost(i));
+      row["gen_" + name] = fi->nodes_generated;
+      row[(distance_only? "dlive_": "live_") + name] = fi->get_peak_live();
+    }
+    return dists;
+  };
+  for (string name: {"ki", "hi", "fi"}) {
+    vector<double> full = run(name, false);
+    vector<double> dist = run(name, true);
+    bool same = full.size() == dist.size();
+    for (size_t i=0; same && i<full.size(); i++)
+      same = fabs(full[i] - dist[i]) <= EPSILON;
+    if (!same) mismatch++;
+  }
+  row["k"] = k;
+  row["mismatch"] = mismatch;
+  for (int i=0; i<(int)cols.size(); i++) {
+    cout << setw(10) << row[cols[i]];
+    if (i+1 == (int)cols.size()) cout << endl;
+    else cout << ",";
+  }
+}
+
+void parallel_experiment(int max_threads) {
+  // the longest of 1000 random queries, which are the ones worth splitting
+  const int N = 1000, Q = 20;
+  vector<pl::Point> ss, gs;
+  generator::gen_points_in_traversable(oMap, polys, N, ss);
+  generator::gen_points_in_traversable(oMap, polys, N, gs);
+  vector<pair<double, int>> order;
+  for (int i=0; i<N; i++) order.push_back({-ss[i].distance(gs[i]), i});
+  sort(order.begin(), order.end());
+  order.resize(min(Q, N));
+
+  vector<double> serial_cost(order.size(), -1);
+  double serial_micro = 0, serial_gen = 0;
+  for (size_t q=0; q<order.size(); q++) {
+    int i = order[q].second;
+    si->set_start_goal(ss[i], gs[i]);
+    si->search();
+    serial_cost[q] = si->get_cost();
+    serial_micro += si->get_search_micro();
+    serial_gen += si->nodes_generated;
+  }
+
+  vector<string> headers = {"threads", "queries", "cost", "gen", "messages", "speedup", "mismatch"};
+  print_header(headers);
+  cout << setw(10) << "serial" << "," << setw(10) << order.size() << ","
+       << setw(10) << serial_micro << "," << setw(10) << serial_gen << ","
+       << setw(10) << 0 << "," << setw(10) << 1 << "," << setw(10) << 0 << endl;
+  for (int threads=1; threads<=max_threads; threads*=2) {
+    pl::ParallelSearchInstance psi(mp, threads);
+    double micro = 0, gen = 0, msgs = 0;
+    int mismatch = 0;
+    for (size_t q=0; q<order.size(); q++) {
+      int i = order[q].second;
+      psi.set_start_goal(ss[i], gs[i]);
+      psi.search();
+      if (fabs(psi.get_cost() - serial_cost[q]) > EPSILON) mismatch++;
+      micro += psi.get_search_micro();
+      gen += psi.nodes_generated;
+      msgs += psi.messages;
+    }
+    cout << setw(10) << threads << "," << setw(10) << order.size() << ","
+         << setw(10) << micro << "," << setw(10) << gen << ","
+         << setw(10) << msgs << "," << setw(10) << serial_micro / micro << ","
+         << setw(10) << mismatch << endl;
+  }
+}
+
+void rtree_experiment(int max_exp) {
+  // build and kNN query cost of one-by-one R* insertion vs STR bulk loading,
+  // and of the flat copy of the STR tree
+  const int Q = 1000, K = 10;
+  vector<rstar::Point> qs;
+  auto rand_point = [&]() {
+    double x = mp->get_minx() + (mp->get_maxx() - mp->get_minx()) * rand() / RAND_MAX;
+    double y = mp->get_miny() + (mp->get_maxy() - mp->get_miny()) * rand() / RAND_MAX;
+    return rstar::Point(x, y);
+  };
+  for (int i=0; i<Q; i++) qs.push_back(rand_point());
+
+  vector<string> headers = {"n", "build_ins", "build_str", "query_ins", "query_str", "query_flat", "h_ins", "h_str", "mismatch"};
+  print_header(headers);
+  for (int e=4, n=10000; e<=max_exp; e++, n*=10) {
+    vector<rstar::LeafNodeEntry> entries;
+    vector<int> ids(n);
+    entries.reserve(n);
+    for (int i=0; i<n; i++) {
+      ids[i] = i;
+      rstar::Point p = rand_point();
+      entries.push_back(rstar::LeafNodeEntry(rstar::Mbr(p.coord[0], p.coord[0], p.coord[1], p.coord[1]), &ids[i]));
+    }
+    rstar::Entry_P_V ptrs;
+    for (auto& it: entries) ptrs.push_back(&it);
+
+    warthog::timer timer;
+    rstar::RStarTree ins, str;
+    timer.start();
+    for (auto& it: ptrs) ins.insertData(it);
+    timer.stop();
+    double build_ins = timer.elapsed_time_micro();
+    timer.start();
+    str.bulkLoad(ptrs);
+    timer.stop();
+    double build_str = timer.elapsed_time_micro();
+
+    auto query = [&](rstar::RStarTree& tree, vector<double>& dists) {
+      timer.start();
+      for (auto& q: qs) {
+        rstar::MinHeap heap;
+        heap.push(rstar::MinHeapEntry(0, tree.root));
+        for (int i=0; i<K; i++) {
+          rstar::MinHeapEntry res = rstar::RStarTreeUtil::iNearestNeighbour(heap, q);
+          dists.push_back(res.key);
+        }
+      }
+      timer.stop();
+      return timer.elapsed_time_micro() / Q;
+    };
+    vector<double> dins, dstr, dflat;
+    double query_ins = query(ins, dins);
+    double query_str = query(str, dstr);
+
+    rstar::StaticRTree flat;
+    flat.build(str);
+    timer.start();
+    for (auto& q: qs) {
+      rstar::StaticMinHeap heap;
+      flat.start(heap, q);
+      for (int i=0; i<K; i++)
+        dflat.push_back(flat.iNearestNeighbour(heap, q).key);
+    }
+    timer.stop();
+    double query_flat = timer.elapsed_time_micro() / Q;
+
+    int mismatch = 0;
+    for (size_t i=0; i<dins.size(); i++)
+      if (fabs(dins[i] - dstr[i]) > EPSILON || fabs(dins[i] - dflat[i]) > EPSILON) mismatch++;
+    cout << setw(10) << n << "," << setw(10) << build_ins << "," << setw(10) << build_str << ","
+         << setw(10) << query_ins << "," << setw(10) << query_str << "," << setw(10) << query_flat << ","
+         << setw(10) << ins.root->level + 1 << "," << setw(10) << str.root->level + 1 << ","
+         << setw(10) << mismatch << endl;
+  }
+}
+
+void update_experiment(double ratio) {
+  // cost of one add / remove / move of a target in TargetHeuristic and the fences
+  const int U = 1000;
+  int targetSize = mp->mesh_vertices.size() * ratio + 1;
+  pts.clear();
+  generator::gen_points_in_traversable(oMap, polys, targetSize, pts);
+  vector<pl::Point> fresh;
+  generator::gen_points_in_traversable(oMap, polys, U, fresh);
+  hi->set_goals(pts);
+
+  warthog::timer timer;
+  vector<int> added;
+  timer.start();
+  for (auto& p: fresh) added.push_back(hi->add_target(p));
+  timer.stop();
+  double add = timer.elapsed_time_micro() / U;
+  timer.start();
+  for (int i=0; i<U; i++) hi->move_target(added[i], pts[i % pts.size()]);
+  timer.stop();
+  double move = timer.elapsed_time_micro() / U;
+  timer.start();
+  for (int gid: added) hi->remove_target(gid);
+  timer.stop();
+  double remove = timer.elapsed_time_micro() / U;
+
+  // the same for the fences: full floodfill vs repairing them for one goal
+  const int F = 100;
+  meshFence->set_goals(pts);
+  meshFence->floodfill();
+  double fence_full = meshFence->get_processing_micro();
+  double fence_add = 0, fence_remove = 0;
+  added.clear();
+  for (int i=0; i<F; i++) {
+    added.push_back(meshFence->add_goal(fresh[i]));
+    fence_add += meshFence->get_processing_micro() / F;
+  }
+  for (int gid: added) {
+    meshFence->remove_goal(gid);
+    fence_remove += meshFence->get_processing_micro() / F;
+  }
+
+  vector<string> headers = {"pts", "add", "remove", "move", "fence_full", "fence_add", "fence_remove"};
+  print_header(headers);
+  cout << setw(10) << pts.size() << "," << setw(10) << add << "," << setw(10) << remove << ","
+       << setw(10) << move << "," << setw(10) << fence_full << "," << setw(10) << fence_add << ","
+       << setw(10) << fence_remove << endl;
+}
+
+void batch_experiment(double ratio, int k, int max_threads) {
+  // one TargetHeuristic query after another vs KnnBatch, time per query
+  const int N = 1000;
+  int targetSize = mp->mesh_vertices.size() * ratio + 1;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  pts.clear();
+  generator::gen_points_in_traversable(oMap, polys, targetSize, pts);
+  hi->set_goals(pts);
+  hi->set_K(k);
+  hi->set_distance_only(true);
+
+  warthog::timer timer;
+  vector<double> single;
+  double gen_single = 0;
+  timer.start();
+  for (auto& start: starts) {
+    hi->set_start(start);
+    int res = hi->search();
+    gen_single += hi->nodes_generated;
+    for (int i=0; i<res; i++) single.push_back(hi->get_cost(i));
+  }
+  timer.stop();
+  double cost_single = timer.elapsed_time_micro() / N;
+  gen_single /= N;
+
+  vector<string> headers = {
+    "pts", "k", "threads", "cost_single", "cost_batch", "gen_single", "gen_batch", "located", "mismatch"
+  };
+  print_header(headers);
+  for (int t=1; t<=max_threads; t*=2) {
+    pl::KnnBatch batch(mp, hi, t);
+    vector<pl::KnnResult> res;
+    batch.search(starts, k, res);
+    int mismatch = 0, j = 0;
+    double gen_batch = 0;
+    for (auto& r: res) {
+      if (!r.duplicate) gen_batch += r.nodes_generated;
+      for (double d: r.dists) if (fabs(d - single[j++]) > EPSILON) mismatch++;
+    }
+    cout << setw(10) << pts.size() << "," << setw(10) << k << "," << setw(10) << t << ","
+         << setw(10) << cost_single << "," << setw(10) << batch.get_search_micro() / N << ","
+         << setw(10) << gen_single << "," << setw(10) << gen_batch / N << ","
+         << setw(10) << batch.get_located() << "," << setw(10) << mismatch << endl;
+  }
+}
+
+void snapshot_experiment(double ratio) {
+  // building the target index vs loading it from a snapshot
+  const string path = "/tmp/oknn-targets.bin";
+  int targetSize = mp->mesh_vertices.size() * ratio + 1;
+  pts.clear();
+  generator::gen_points_in_traversable(oMap, polys, targetSize, pts);
+  warthog::timer timer;
+  timer.start();
+  hi->set_goals(pts);
+  timer.stop();
+  double build = timer.elapsed_time_micro();
+  timer.start();
+  hi->save_targets(path);
+  timer.stop();
+  double save = timer.elapsed_time_micro();
+  pl::TargetHeuristic loaded(mp);
+  timer.start();
+  bool ok = loaded.load_targets(path);
+  timer.stop();
+  double load = timer.elapsed_time_micro();
+  remove(path.c_str());
+
+  vector<string> headers = {"pts", "build", "save", "load", "ok"};
+  print_header(headers);
+  cout << setw(10) << pts.size() << "," << setw(10) << build << "," << setw(10) << save << ","
+       << setw(10) << load << "," << setw(10) << ok << endl;
+}
+
+void fence_index_experiment(double ratio) {
+  // floodfill vs mapping a fence index written by an earlier run
+  const string path = "/tmp/oknn-fences.bin";
+  int targetSize = mp->mesh_vertices.size() * ratio + 1;
+  pts.clear();
+  generator::gen_points_in_traversable(oMap, polys, targetSize, pts);
+  meshFence->set_goals(pts);
+  meshFence->floodfill();
+  double build = meshFence->get_processing_micro();
+  warthog::timer timer;
+  timer.start();
+  meshFence->save_fences(path);
+  timer.stop();
+  double save = timer.elapsed_time_micro();
+  pl::KnnMeshEdgeFence loaded(mp);
+  timer.start();
+  bool ok = loaded.load_fences(path);
+  timer.stop();
+  double load = timer.elapsed_time_micro();
+  ok = ok && loaded.fenceCnt == meshFence->fenceCnt && loaded.get_goals().size() == pts.size();
+  remove(path.c_str());
+
+  vector<string> headers = {"pts", "fences", "bytes", "build", "save", "load", "ok"};
+  print_header(headers);
+  cout << setw(10) << pts.size() << "," << setw(10) << meshFence->fenceCnt << ","
+       << setw(10) << meshFence->get_fence_bytes() << "," << setw(10) << build << ","
+       << setw(10) << save << "," << setw(10) << load << "," << setw(10) << ok << endl;
+}
+
+void lazy_fence_experiment(double ratio, int grid, size_t capacity) {
+  // full floodfill vs fences built on demand, for queries in the middle of
+  // the map only
+  int targetSize = mp->mesh_vertices.size() * ratio + 1;
+  pts.clear();
+  generator::gen_points_in_traversable(oMap, polys, targetSize, pts);
+  double minx = INF, maxx = -INF, miny = INF, maxy = -INF;
+  for (const pl::Vertex& v: mp->mesh_vertices) {
+    minx = min(minx, v.p.x); maxx = max(maxx, v.p.x);
+    miny = min(miny, v.p.y); maxy = max(maxy, v.p.y);
+  }
+  vector<pl::Point> cands, qs;
+  generator::gen_points_in_traversable(oMap, polys, 4000, cands);
+  for (const pl::Point& p: cands) {
+    if (fabs(p.x - (minx + maxx) / 2) < (maxx - minx) / 8 &&
+        fabs(p.y - (miny + maxy) / 2) < (maxy - miny) / 8) qs.push_back(p);
+  }
+  const int k = 5;
+  fi->set_goals(pts);
+  fi->set_K(k);
+  const auto query = [&](double& cost, double& gen, double& build, vector<double>& dists) {
+    cost = gen = build = 0;
+    dists.clear();
+    for (const pl::Point& q: qs) {
+      const int before = meshFence->lazy_built;
+      fi->set_start(q);
+      const int res = fi->search();
+      cost += fi->get_search_micro();
+      gen += fi->nodes_generated;
+      if (meshFence->lazy_built != before) build += meshFence->get_processing_micro();
+      for (int i=0; i<res; i++) dists.push_back(fi->get_cost(i));
+    }
+    cost /= max((size_t)1, qs.size());
+    gen /= max((size_t)1, qs.size());
+  };
+
+  meshFence->set_goals(pts);
+  meshFence->floodfill();
+  double build_full = meshFence->get_processing_micro();
+  int fences_full = meshFence->fenceCnt;
+  double cost_full, gen_full, unused;
+  vector<double> full_dists, lazy_dists;
+  query(cost_full, gen_full, unused, full_dists);
+
+  meshFence->set_lazy(grid, capacity);
+  meshFence->set_goals(pts);
+  meshFence->lazy_built = meshFence->lazy_evicted = 0;
+  double cost_lazy, gen_lazy, build_lazy;
+  query(cost_lazy, gen_lazy, build_lazy, lazy_dists);
+  double distdiff = full_dists.size() == lazy_dists.size()? 0: INF;
+  for (size_t i=0; i<full_dists.size() && i<lazy_dists.size(); i++)
+    distdiff += fabs(full_dists[i] - lazy_dists[i]);
+
+  vector<string> headers = {
+    "pts", "queries", "fences_full", "build_full", "cost_fi_full", "gen_fi_full", "regions",
+    "built", "evicted", "fences_lazy", "build_lazy", "cost_fi_lazy", "gen_fi_lazy", "distdiff"
+  };
+  print_header(headers);
+  vector<double> row = {
+    (double)pts.size(), (double)qs.size(), (double)fences_full, build_full, cost_full, gen_full,
+    (double)grid * grid, (double)meshFence->lazy_built, (double)meshFence->lazy_evicted,
+    (double)meshFence->get_lazy_fence_num(), build_lazy, cost_lazy, gen_lazy, distdiff
+  };
+  for (int i=0; i<(int)row.size(); i++) {
+    cout << setw(10) << row[i];
+    if (i+1 == (int)row.size()) cout << endl;
+    else cout << ",";
+  }
+  meshFence->set_lazy(0, 0);
+}
+
+void fence_depth_experiment(int depth, int N) {
+  // kNN latency of TargetHeuristic and FenceHeuristic with fences of depth
+  // 1 and depth, for the k values of the "k" mode
+  int targetNum = mp->mesh_vertices.size() / 100 + 1;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  pts.clear();
+  generator::gen_points_in_traversable(oMap, polys, targetNum, pts);
+  hi->set_goals(pts);
+  fi->set_goals(pts);
+  meshFence->set_goals(pts);
+  const int ks[] = {1, 5, 10, 25, 50};
+  // [k][0]: hi, [k][1]: fi with depth 1, [k][2]: fi with depth
+  double cost[5][3] = {}, gen[5][3] = {}, pre[2], fences[2];
+  // distances with depth 1, checked against those with depth
+  vector<vector<double>> dists(5);
+  double mismatch[5] = {};
+  for (int d=0; d<2; d++) {
+    meshFence->set_fence_depth(d == 0? 1: depth);
+    meshFence->floodfill();
+    pre[d] = meshFence->get_processing_micro();
+    fences[d] = meshFence->fenceCnt;
+    for (int i=0; i<5; i++) {
+      fi->set_K(ks[i]);
+      hi->set_K(ks[i]);
+      size_t at = 0;
+      for (const pl::Point& start: starts) {
+        fi->set_start(start);
+        const int res = fi->search();
+        cost[i][d+1] += fi->get_search_micro();
+        gen[i][d+1] += fi->nodes_generated;
+        for (int j=0; j<res; j++) {
+          if (d == 0) dists[i].push_back(fi->get_cost(j));
+          else if (at >= dists[i].size() || fabs(dists[i][at++] - fi->get_cost(j)) > EPSILON) mismatch[i]++;
+        }
+        if (d == 0) {
+          hi->set_start(start);
+          hi->search();
+          cost[i][0] += hi->get_search_micro();
+          gen[i][0] += hi->nodes_generated;
+        }
+      }
+    }
+  }
+  meshFence->set_fence_depth(1);
+
+  vector<string> headers = {
+    "k", "depth", "pts", "cost_hi", "gen_hi", "cost_fi", "gen_fi", "cost_fid", "gen_fid",
+    "pre_fi", "pre_fid", "fences", "fences_d", "mismatch"
+  };
+  print_header(headers);
+  for (int i=0; i<5; i++) {
+    vector<double> row = {
+      (double)ks[i], (double)depth, (double)pts.size(), cost[i][0] / N, gen[i][0] / N,
+      cost[i][1] / N, gen[i][1] / N, cost[i][2] / N, gen[i][2] / N, pre[0], pre[1],
+      fences[0], fences[1], mismatch[i]
+    };
+    for (int j=0; j<(int)row.size(); j++) {
+      cout << setw(10) << row[j];
+      if (j+1 == (int)row.size()) cout << endl;
+      else cout << ",";
+    }
+  }
+}
+
+void hierarchy_experiment(double ratio, int cluster_size, double frac) {
+  // full floodfill vs a coarse level over clusters of cluster_size polygons
+  // with fences up to frac of the map diagonal from the goals
+  int targetSize = mp->mesh_vertices.size() * ratio + 1;
+  pts.clear();
+  generator::gen_points_in_traversable(oMap, polys, targetSize, pts);
+  starts.clear();
+  generator::gen_points_in_traversable(oMap, polys, 200, starts);
+  double minx = INF, maxx = -INF, miny = INF, maxy = -INF;
+  for (const pl::Vertex& v: mp->mesh_vertices) {
+    minx = min(minx, v.p.x); maxx = max(maxx, v.p.x);
+    miny = min(miny, v.p.y); maxy = max(maxy, v.p.y);
+  }
+  const double bound = frac * pl::Point{minx, miny}.distance(pl::Point{maxx, maxy});
+  const int k = 5;
+  fi->set_goals(pts);
+  fi->set_K(k);
+  const auto query = [&](double& cost, double& gen, vector<double>& dists) {
+    cost = gen = 0;
+    dists.clear();
+    for (const pl::Point& q: starts) {
+      fi->set_start(q);
+      const int res = fi->search();
+      cost += fi->get_search_micro();
+      gen += fi->nodes_generated;
+      for (int i=0; i<res; i++) dists.push_back(fi->get_cost(i));
+    }
+    cost /= starts.size();
+    gen /= starts.size();
+  };
+
+  meshFence->set_goals(pts);
+  meshFence->floodfill();
+  double build_full = meshFence->get_processing_micro();
+  double bytes_full = meshFence->get_fence_bytes();
+  int fences_full = meshFence->fenceCnt;
+  double cost_full, gen_full;
+  vector<double> full_dists, hier_dists;
+  query(cost_full, gen_full, full_dists);
+
+  meshFence->set_hierarchy(cluster_size, bound);
+  meshFence->set_goals(pts);
+  meshFence->floodfill();
+  double build_hier = meshFence->get_processing_micro();
+  double bytes_hier = meshFence->get_fence_bytes();
+  int fences_hier = meshFence->fenceCnt;
+  double cost_hier, gen_hier;
+  query(cost_hier, gen_hier, hier_dists);
+  double distdiff = full_dists.size() == hier_dists.size()? 0: INF;
+  for (size_t i=0; i<full_dists.size() && i<hier_dists.size(); i++)
+    distdiff += fabs(full_dists[i] - hier_dists[i]);
+
+  vector<string> headers = {
+    "pts", "clusters", "bound", "fences_full", "bytes_full", "build_full", "cost_fi_full",
+    "gen_fi_full", "fences_hier", "bytes_hier", "build_hier", "cost_fi_hier", "gen_fi_hier",
+    "distdiff"
+  };
+  print_header(headers);
+  vector<double> row = {
+    (double)pts.size(), (double)meshFence->get_cluster_num(), bound, (double)fences_full,
+    bytes_full, build_full, cost_full, gen_full, (double)fences_hier, bytes_hier, build_hier,
+    cost_hier, gen_hier, distdiff
+  };
+  for (int i=0; i<(int)row.size(); i++) {
+    cout << setw(10) << row[i];
+    if (i+1 == (int)row.size()) cout << endl;
+    else cout << ",";
+  }
+  meshFence->set_hierarchy(0, INF);
+}
+
+// Nodes entering every non-triangle polygon through each of its edges, rooted
+// at the centroid of the neighbouring polygon; used to benchmark get_successors
+// in isolation.
+void gen_successor_nodes(vector<pl::SearchNode>& nodes, vector<pl::Point>& roots) {
+  const double ratios[][2] = {{0, 1}, {0.25, 0.75}, {0.1, 0.6}};
+  for (int pid=0; pid<(int)mp->mesh_polygons.size(); pid++) {
+    const pl::Polygon& poly = mp->mesh_polygons[pid];
+    const vector<int>& V = poly.vertices;
+    const int N = (int)V.size();
+    if (N <= 3) continue;
+    for (int j=0; j<N; j++) {
+      int q = poly.polygons[j];
+      if (q == -1) continue;
+      pl::Point root = {0, 0};
+      for (int vid: mp->mesh_polygons[q].vertices) root = root + mp->mesh_vertices[vid].p;
+      root = root * (1.0 / mp->mesh_polygons[q].vertices.size());
+      int rv = V[j], lv = V[(j+N-1)%N];
+      const pl::Point& lp = mp->mesh_vertices[lv].p;
+      const pl::Point& rp = mp->mesh_vertices[rv].p;
+      for (const auto& r: ratios) {
+        pl::Point left = lp + (rp - lp) * r[0];
+        pl::Point right = lp + (rp - lp) * r[1];
+        if (pl::get_orientation(root, left, right) != pl::Orientation::CW) continue;
+        nodes.push_back(pl::SearchNode(nullptr, -1, left, right, lv, rv, pid, 0, 0));
+        roots.push_back(root);
+      }
+    }
+  }
+}
+
+void successor_experiment(int reps) {
+  vector<pl::SearchNode> nodes;
+  vector<pl::Point> roots;
+  gen_successor_nodes(nodes, roots);
+  pl::Successor* succs = new pl::Successor[mp->max_poly_sides + 2];
+  pl::Successor* expected = new pl::Successor[mp->max_poly_sides + 2];
+
+  vector<string> headers = {"kernel", "nodes", "reps", "cost", "ns_per_call", "mismatch"};
+  print_header(headers);
+  const pl::OrientKernel kernels[] = {
+    pl::OrientKernel::BINARY_SEARCH, pl::OrientKernel::SCALAR,
+    pl::OrientKernel::SSE2, pl::OrientKernel::AVX2
+  };
+  for (pl::OrientKernel kernel: kernels) {
+    if (pl::set_orient_kernel(kernel) != kernel) continue; // unsupported cpu
+    int mismatch = 0;
+    for (size_t i=0; i<nodes.size(); i++) {
+      pl::set_orient_kernel(pl::OrientKernel::BINARY_SEARCH);
+      int n0 = pl::get_successors(nodes[i], roots[i], *mp, expected);
+      pl::set_orient_kernel(kernel);
+      int n1 = pl::get_successors(nodes[i], roots[i], *mp, succs);
+      bool same = n0 == n1;
+      for (int j=0; same && j<n0; j++) {
+        same = expected[j].type == succs[j].type &&
+               expected[j].left == succs[j].left &&
+               expected[j].right == succs[j].right &&
+               expected[j].poly_left_ind == succs[j].poly_left_ind;
+      }
+      if (!same) mismatch++;
+    }
+
+    warthog::timer timer;
+    long long checksum = 0;
+    timer.start();
+    for (int r=0; r<reps; r++) {
+      for (size_t i=0; i<nodes.size(); i++) {
+        checksum += pl::get_successors(nodes[i], roots[i], *mp, succs);
+      }
+    }
+    timer.stop();
+    double calls = (double)reps * nodes.size();
+    cout << setw(10) << pl::orient_kernel_name(kernel) << ","
+         << setw(10) << nodes.size() << ","
+         << setw(10) << reps << ","
+         << setw(10) << timer.elapsed_time_micro() << ","
+         << setw(10) << (calls > 0? timer.elapsed_time_nano() / calls: 0) << ","
+         << setw(10) << mismatch << endl;
+    if (checksum < 0) cerr << checksum << endl;
+  }
+  pl::set_orient_kernel(pl::OrientKernel::AUTO);
+  delete[] succs;
+  delete[] expected;
+}
+
 int main(int argv, char* args[]) {
   load_data();
   vector<string> cols = {
@@ -659,16 +1277,59 @@ int main(int argv, char* args[]) {
         int targetSize = (int)mp->mesh_vertices.size() * targetRatio + 1;
         generator::gen_points_in_traversable(oMap, polys, targetSize, targets);
       }
+      // ./bin/experiment fence {ratio} [random|cluster] [threads] [budget] < {input file}
+      int threads = argv >= 5? atoi(args[4]): 1;
+      int budget = argv >= 6? atoi(args[5]): 0;
+      // FenceHeuristic cost over the current fences, k=5 from random starts
+      int N = 1000, k = min(5, (int)targets.size());
+      generator::gen_points_in_traversable(oMap, polys, N, starts);
+      double fi_cost = 0, fi_gen = 0;
+      vector<double> fi_dists;
+      const auto query = [&]() {
+        fi_cost = fi_gen = 0;
+        fi_dists.clear();
+        fi->set_goals(targets);
+        fi->set_K(k);
+        for (auto& start: starts) {
+          fi->set_start(start);
+          int res = fi->search();
+          for (int i=0; i<res; i++) fi_dists.push_back(fi->get_cost(i));
+          fi_cost += fi->get_search_micro();
+          fi_gen += fi->nodes_generated;
+        }
+      };
+      // with a budget, the same queries over all fences first
+      double bytes_full = 0, cost_fi_full = 0, gen_fi_full = 0, distdiff = 0;
+      vector<double> full_dists;
       meshFence->set_goals(targets);
-      meshFence->floodfill();
+      if (budget > 0) {
+        meshFence->set_fence_budget(0);
+        meshFence->floodfill(threads);
+        query();
+        bytes_full = meshFence->get_fence_bytes();
+        cost_fi_full = fi_cost / N;
+        gen_fi_full = fi_gen / N;
+        full_dists = fi_dists;
+      }
+      meshFence->set_fence_budget(budget);
+      meshFence->floodfill(threads);
+      query();
+      meshFence->set_fence_budget(0);
+      if (budget > 0) {
+        distdiff = full_dists.size() == fi_dists.size()? 0: INF;
+        for (size_t i=0; i<full_dists.size() && i<fi_dists.size(); i++)
+          distdiff += fabs(full_dists[i] - fi_dists[i]);
+      }
       vector<string> headers = {
-        "edgecnt", "totalfence", "keycnt", "pts", "polys", "gen", "cost", "fencecnt"
+        "edgecnt", "totalfence", "keycnt", "pts", "polys", "gen", "cost", "fencecnt",
+        "dropped", "bytes", "cost_fi", "gen_fi", "budget", "capped", "bytes_full",
+        "cost_fi_full", "gen_fi_full", "distdiff"
       };
       print_header(headers);
-      const auto fences = meshFence->get_all_fences();
-      for (const auto& it: fences) {
+      for (int e=0; e<meshFence->get_edge_num(); e++) {
+        if (meshFence->get_fence_num(e) == 0) continue;
         map<string, double> row;
-        row["fencecnt"] = (int)it.second.size();
+        row["fencecnt"] = meshFence->get_fence_num(e);
         row["edgecnt"] = meshFence->edgecnt;
         row["totalfence"] = meshFence->fenceCnt;
         row["keycnt"] = meshFence->get_active_edge_cnt();
@@ -676,6 +1337,16 @@ int main(int argv, char* args[]) {
         row["polys"] = polys.size();
         row["gen"] = meshFence->nodes_generated;
         row["cost"] = meshFence->get_processing_micro();
+        row["dropped"] = meshFence->fences_dropped;
+        row["bytes"] = meshFence->get_fence_bytes();
+        row["cost_fi"] = fi_cost / N;
+        row["gen_fi"] = fi_gen / N;
+        row["budget"] = budget;
+        row["capped"] = meshFence->capped_edges;
+        row["bytes_full"] = bytes_full;
+        row["cost_fi_full"] = cost_fi_full;
+        row["gen_fi_full"] = gen_fi_full;
+        row["distdiff"] = distdiff;
         for (int i=0; i<(int)headers.size(); i++) {
           cout << setw(10) << row[headers[i]];
           if (i+1 == (int)headers.size()) cout << endl;
@@ -683,6 +1354,66 @@ int main(int argv, char* args[]) {
         }
       }
     }
+    else if (t == "distonly") { // peak live nodes with and without paths
+      // ./bin/experiment distonly {ratio} {k} < {input file}
+      double ratio = atof(args[2]);
+      int targetSize = mp->mesh_vertices.size() * ratio + 1;
+      int k = atoi(args[3]);
+      int N = 1000;
+      generator::gen_points_in_traversable(oMap, polys, N, starts);
+      pts.clear();
+      generator::gen_points_in_traversable(oMap, polys, targetSize, pts);
+      meshFence->set_goals(pts);
+      meshFence->floodfill();
+      hi->set_goals(pts);
+      fi->set_goals(pts);
+      vector<string> dcols = {"k", "gen_ki", "live_ki", "dlive_ki", "gen_hi", "live_hi", "dlive_hi",
+                              "gen_fi", "live_fi", "dlive_fi", "mismatch"};
+      print_header(dcols);
+      for (auto& start: starts) {
+        distance_only_experiment(start, k, dcols);
+      }
+    }
+    else if (t == "parallel") { // scaling of hash-distributed polyanya
+      // ./bin/experiment parallel {max threads} < inputs/street-maps/{map}.in
+      parallel_experiment(atoi(args[2]));
+    }
+    else if (t == "rtree") { // R-tree build and query cost
+      // ./bin/experiment rtree {max exponent, 4..7} < {input file}
+      rtree_experiment(atoi(args[2]));
+    }
+    else if (t == "batch") { // batched kNN queries
+      // ./bin/experiment batch {ratio} {k} {max threads} < {input file}
+      batch_experiment(atof(args[2]), atoi(args[3]), atoi(args[4]));
+    }
+    else if (t == "snapshot") { // target index build vs snapshot load
+      // ./bin/experiment snapshot {ratio} < {input file}
+      snapshot_experiment(atof(args[2]));
+    }
+    else if (t == "fenceindex") { // floodfill vs fence index load
+      // ./bin/experiment fenceindex {ratio} < {input file}
+      fence_index_experiment(atof(args[2]));
+    }
+    else if (t == "fencek") { // kNN from fences of several goals per edge
+      // ./bin/experiment fencek {depth} {starts} < {input file}
+      fence_depth_experiment(atoi(args[2]), atoi(args[3]));
+    }
+    else if (t == "hier") { // coarse cluster level over bounded fences
+      // ./bin/experiment hier {ratio} {cluster size} {bound / map diagonal} < {input file}
+      hierarchy_experiment(atof(args[2]), atoi(args[3]), atof(args[4]));
+    }
+    else if (t == "lazy") { // fences built on demand
+      // ./bin/experiment lazy {ratio} {grid} {capacity} < {input file}
+      lazy_fence_experiment(atof(args[2]), atoi(args[3]), atol(args[4]));
+    }
+    else if (t == "update") { // dynamic target update cost
+      // ./bin/experiment update {ratio} < {input file}
+      update_experiment(atof(args[2]));
+    }
+    else if (t == "succ") { // get_successors microbenchmark
+      // ./bin/experiment succ {repeats} < {input file}
+      successor_experiment(atoi(args[2]));
+    }
     else if (t == "cluster") {
       string starts_path = string(args[2]);
       int k = atoi(args[3]);
@@ -3,6 +3,7 @@
 #include "point.h"
 #include "genPoints.h"
 #include "park2poly.h"
+#include "knnMeshFence.h"
 #include <string>
 #include <sstream>
 #include <random>
@@ -72,6 +73,26 @@ void gen_clusters(string polypath, string pointpath, string meshpath, int maxNum
   generator::gen_clusters_in_traversable(oMap, mp, maxNum, pts, out, radius, true);
 }
 
+void gen_fences(string meshpath, string pointpath, string outpath, int threads) {
+  ifstream meshfile(meshpath);
+  ifstream pointfile(pointpath);
+  polyanya::Mesh* mp = new polyanya::Mesh(meshfile);
+  int N;
+  pointfile >> N;
+  vector<pl::Point> pts(N);
+  for (int i=0; i<N; i++) pointfile >> pts[i].x >> pts[i].y;
+
+  pl::KnnMeshEdgeFence meshFence(mp);
+  meshFence.set_goals(pts);
+  meshFence.floodfill(threads);
+  if (!meshFence.save_fences(outpath)) {
+    cerr << "cannot write " << outpath << endl;
+    return;
+  }
+  cerr << "fences: " << meshFence.fenceCnt << ", floodfill: "
+       << meshFence.get_processing_micro() << "us" << endl;
+}
+
 int main(int argc, char* argv[]) {
   if (argc > 1) {
     string t = string(argv[1]);
@@ -104,6 +125,14 @@ int main(int argc, char* argv[]) {
         radius = atof(argv[6]);
       gen_clusters(polypath, pointpath, meshpath, maxNum, radius);
     }
+    else if (t == "fence") {
+      // ./bin/gen fence {mesh} {points} {output} [threads]
+      string meshpath = string(argv[2]);
+      string pointpath = string(argv[3]);
+      string outpath = string(argv[4]);
+      int threads = argc > 5? atoi(argv[5]): 1;
+      gen_fences(meshpath, pointpath, outpath, threads);
+    }
   }
   return 0;
 }
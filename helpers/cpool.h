@@ -63,6 +63,14 @@ class cchunk
         inline char*
         allocate()
         {
+            // recycle freed objects first, so the touched part of the
+            // chunk only grows with the number of live objects
+            if(stack_size_ > 0)
+            {
+                --stack_size_;
+                return mem_ + freed_stack_[stack_size_];
+            }
+
             if(next_ < max_)
             {
                 char* retval = next_;
@@ -70,12 +78,6 @@ class cchunk
                 return retval;
             }
 
-            if(stack_size_ > 0)
-            {
-                --stack_size_;
-                return mem_ + freed_stack_[stack_size_];
-            }
-
             return 0;
         }
 
@@ -83,7 +85,7 @@ class cchunk
         deallocate(char* addr)
         {
             #ifndef NDEBUG
-            assert(mem_ >= addr);
+            assert(addr >= mem_);
             if((unsigned)(addr-mem_) >= pool_size_)
             {
                 std::cerr << "err; warthog::mem::cchunk; freeing memory outside"
@@ -99,7 +101,7 @@ class cchunk
         contains(char* addr)
         {
             #ifndef NDEBUG
-            assert(mem_ >= addr);
+            assert(addr >= mem_);
             #endif
             if((unsigned)(addr-mem_) < pool_size_)
             {
@@ -153,13 +155,15 @@ class cpool
 {
     public:
         cpool (size_t obj_size, size_t max_chunks) :
-            num_chunks_(0), max_chunks_(max_chunks), obj_size_(obj_size)
+            num_chunks_(0), max_chunks_(max_chunks), obj_size_(obj_size),
+            live_(0), peak_live_(0)
         {
             init();
         }
 
         cpool(size_t obj_size) :
-            num_chunks_(0), max_chunks_(20), obj_size_(obj_size)
+            num_chunks_(0), max_chunks_(20), obj_size_(obj_size),
+            live_(0), peak_live_(0)
         {
             init();
         }
@@ -180,11 +184,17 @@ class cpool
             {
                 chunks_[i]->reclaim();
             }
+            live_ = 0;
+            peak_live_ = 0;
         }
 
         inline char*
         allocate()
         {
+            if(++live_ > peak_live_)
+            {
+                peak_live_ = live_;
+            }
             char* mem_ptr = current_chunk_->allocate();
             if(!mem_ptr)
             {
@@ -218,6 +228,7 @@ class cpool
                         < chunks_[i]->pool_size())
                 {
                     chunks_[i]->deallocate(addr);
+                    live_--;
                     return;
                 }
             }
@@ -227,6 +238,20 @@ class cpool
             #endif
         }
 
+        // objects allocated and not yet deallocated since reclaim()
+        size_t
+        live()
+        {
+            return live_;
+        }
+
+        // largest value of live() since reclaim()
+        size_t
+        peak_live()
+        {
+            return peak_live_;
+        }
+
         size_t
         mem()
         {
@@ -260,6 +285,8 @@ class cpool
         size_t num_chunks_;
         size_t max_chunks_;
         size_t obj_size_;
+        size_t live_;
+        size_t peak_live_;
 
         // no copy
         cpool(const warthog::mem::cpool& other) { }
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+
+namespace polyanya
+{
+
+// 64-bit FNV-1a over the bytes fed to it, the hash of the mesh and of the
+// goal set that index files are checked against.
+class Fnv1a
+{
+    unsigned long long h;
+
+    public:
+        Fnv1a() : h(14695981039346656037ull) { }
+
+        void add(const void* data, size_t size)
+        {
+            const unsigned char* bytes = (const unsigned char*) data;
+            for (size_t i = 0; i < size; i++)
+            {
+                h = (h ^ bytes[i]) * 1099511628211ull;
+            }
+        }
+
+        unsigned long long get() const { return h; }
+};
+
+}
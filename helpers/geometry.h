@@ -135,6 +135,39 @@ inline double get_angle(const Point& p, bool is360=false) {
   return res;
 }
 
+// v is inside the wedge swept counterclockwise from direction u0 to u1,
+// boundaries included; the wedge can be reflex.
+inline bool in_wedge(const Point& v, const Point& u0, const Point& u1) {
+  const double c = u0 * u1;
+  const bool after0 = u0 * v > -EPSILON;
+  const bool before1 = v * u1 > -EPSILON;
+  if (c > EPSILON) return after0 && before1;
+  if (c < -EPSILON) return after0 || before1;
+  if (u0.x * u1.x + u0.y * u1.y < 0) return after0; // half plane
+  return after0 && before1 && u0.x * v.x + u0.y * v.y > -EPSILON; // ray
+}
+
+// the ray a + t*u, t >= 0 meets the box [xmin, xmax] x [ymin, ymax]
+inline bool ray_hits_box(const Point& a, const Point& u,
+                         double xmin, double xmax, double ymin, double ymax) {
+  double t0 = 0, t1 = INF;
+  const double lo[2] = {xmin - EPSILON, ymin - EPSILON};
+  const double hi[2] = {xmax + EPSILON, ymax + EPSILON};
+  const double o[2] = {a.x, a.y}, d[2] = {u.x, u.y};
+  for (int i=0; i<2; i++) {
+    if (d[i] == 0) {
+      if (o[i] < lo[i] || o[i] > hi[i]) return false;
+      continue;
+    }
+    double ta = (lo[i] - o[i]) / d[i], tb = (hi[i] - o[i]) / d[i];
+    if (ta > tb) std::swap(ta, tb);
+    t0 = std::max(t0, ta);
+    t1 = std::min(t1, tb);
+    if (t0 > t1) return false;
+  }
+  return true;
+}
+
 inline bool is_intersect(const Point& p0, const Point& p1, const Point& q0, const Point& q1) {
   // from https://stackoverflow.com/questions/563198/whats-the-most-efficent-way-to-calculate-where-two-line-segments-intersect
   Point r = p1 - p0;
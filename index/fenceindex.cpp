@@ -0,0 +1,207 @@
+#include "fenceindex.h"
+#include "fnv.h"
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace polyanya
+{
+
+namespace
+{
+
+const char MAGIC[8] = {'O', 'K', 'N', 'N', 'F', 'I', 'D', 'X'};
+const uint32_t VERSION = 4;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t fence_size;
+    uint64_t mesh_hash;
+    uint64_t goals_hash;
+    uint32_t goal_num;
+    uint32_t edge_num;
+    uint32_t fence_num;
+    uint32_t rest_num;
+    uint32_t depth;
+    double bound;
+};
+
+size_t padded(size_t size)
+{
+    return (size + 7) & ~(size_t) 7;
+}
+
+void put(std::ofstream& out, const void* data, size_t size)
+{
+    static const char zeros[8] = {0};
+    out.write((const char*) data, size);
+    out.write(zeros, padded(size) - size);
+}
+
+// Points into the mapping at the next array, checking its bound.
+template<typename T>
+bool take(const char* data, size_t size, size_t& pos, size_t n, const T*& out)
+{
+    const size_t bytes = n * sizeof(T);
+    if (bytes / sizeof(T) != n || pos + padded(bytes) > size)
+    {
+        return false;
+    }
+    out = (const T*) (data + pos);
+    pos += padded(bytes);
+    return true;
+}
+
+}
+
+unsigned long long hash_goals(const std::vector<Point>& goals, const std::vector<char>& alive)
+{
+    Fnv1a h;
+    const int n = (int) goals.size();
+    h.add(&n, sizeof(n));
+    for (int i = 0; i < n; i++)
+    {
+        h.add(&goals[i].x, sizeof(double));
+        h.add(&goals[i].y, sizeof(double));
+        h.add(&alive[i], sizeof(char));
+    }
+    return h.get();
+}
+
+bool save_fence_index(const std::string& path, unsigned long long mesh_hash,
+                      const std::vector<Point>& goals, const std::vector<char>& alive,
+                      const int* offsets, const std::vector<double>& first_ub,
+                      const std::vector<float>& rest_lb, int depth, double bound,
+                      FenceRange fences)
+{
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.fence_size = sizeof(Fence);
+    h.mesh_hash = mesh_hash;
+    h.goals_hash = hash_goals(goals, alive);
+    h.goal_num = goals.size();
+    h.edge_num = first_ub.size();
+    h.fence_num = fences.size();
+    h.rest_num = rest_lb.size();
+    h.depth = depth;
+    h.bound = bound;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        return false;
+    }
+    put(out, &h, sizeof(h));
+    put(out, goals.data(), goals.size() * sizeof(Point));
+    put(out, alive.data(), alive.size() * sizeof(char));
+    put(out, offsets, (first_ub.size() + 1) * sizeof(int));
+    put(out, first_ub.data(), first_ub.size() * sizeof(double));
+    put(out, rest_lb.data(), rest_lb.size() * sizeof(float));
+    put(out, fences.begin(), fences.size() * sizeof(Fence));
+    return (bool) out;
+}
+
+FenceIndexFile::FenceIndexFile() : map(nullptr), size(0), goals(nullptr), alive(nullptr),
+    goal_num(0), offsets(nullptr), first_ub(nullptr), rest_lb(nullptr), edge_num(0),
+    rest_num(0), depth(1), bound(INF), fences(nullptr), fence_num(0), goals_hash(0)
+{
+}
+
+FenceIndexFile::~FenceIndexFile()
+{
+    if (map != nullptr)
+    {
+        munmap(map, size);
+    }
+}
+
+bool FenceIndexFile::open(const std::string& path, unsigned long long mesh_hash,
+                          unsigned long long expected_goals, int vertex_num)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header))
+    {
+        close(fd);
+        return false;
+    }
+    const size_t file_size = st.st_size;
+    void* m = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+    {
+        return false;
+    }
+    const char* data = (const char*) m;
+
+    Header h;
+    memcpy(&h, data, sizeof(h));
+    size_t pos = padded(sizeof(h));
+    const Point* g;
+    const char* a;
+    const int* o;
+    const double* u;
+    const float* r;
+    const Fence* f;
+    bool ok = memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+              h.version == VERSION && h.fence_size == sizeof(Fence) &&
+              h.mesh_hash == mesh_hash &&
+              (expected_goals == 0 || h.goals_hash == expected_goals) &&
+              take(data, file_size, pos, h.goal_num, g) &&
+              take(data, file_size, pos, h.goal_num, a) &&
+              take(data, file_size, pos, (size_t) h.edge_num + 1, o) &&
+              take(data, file_size, pos, h.edge_num, u) &&
+              (h.rest_num == 0 || h.rest_num == h.edge_num) && h.depth >= 1 &&
+              take(data, file_size, pos, h.rest_num, r) &&
+              take(data, file_size, pos, h.fence_num, f) &&
+              o[0] == 0 && o[h.edge_num] == (int) h.fence_num;
+    for (uint32_t e = 0; ok && e < h.edge_num; e++)
+    {
+        ok = o[e] <= o[e + 1];
+    }
+    // the heuristic reads goals[gid] and the vertex of root of every fence
+    for (uint32_t i = 0; ok && i < h.fence_num; i++)
+    {
+        ok = f[i].gid >= 0 && f[i].gid < (int) h.goal_num &&
+             f[i].root >= -1 && f[i].root < vertex_num;
+    }
+    if (!ok)
+    {
+        munmap(m, file_size);
+        return false;
+    }
+    if (map != nullptr)
+    {
+        munmap(map, size);
+    }
+    map = m;
+    size = file_size;
+    goals = g;
+    alive = a;
+    offsets = o;
+    first_ub = u;
+    rest_lb = r;
+    fences = f;
+    goal_num = h.goal_num;
+    edge_num = h.edge_num;
+    rest_num = h.rest_num;
+    depth = h.depth;
+    bound = h.bound;
+    fence_num = h.fence_num;
+    goals_hash = h.goals_hash;
+    return true;
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "knnMeshFence.h"
+#include "point.h"
+#include <string>
+#include <vector>
+
+namespace polyanya
+{
+
+// Fence index file: the fences of one floodfill together with the goals
+// they were built for, written once (bin/gen fence) and mapped read-only by
+// every process answering queries, so they start without a floodfill.
+//
+// The file is a fixed header followed by the goals, their alive flags, the
+// CSR offsets of the fences by edge, the tightest ub of every edge, the
+// bound of the fences a budget dropped from every edge (if any) and the
+// fences, each 8 byte aligned, in the byte order and Fence layout of the
+// machine that wrote it.  It records the fence depth and bound and the
+// hash of the mesh and of the goal set; opening it against another mesh,
+// another goal set or another format version fails.
+class FenceIndexFile
+{
+    void* map;
+    size_t size;
+
+    public:
+        const Point* goals;
+        const char* alive;
+        int goal_num;
+        const int* offsets;          // edge_num + 1 of them
+        const double* first_ub;
+        const float* rest_lb;        // edge_num of them, or none without a budget
+        int edge_num;
+        int rest_num;
+        int depth;                   // see KnnMeshEdgeFence::set_fence_depth
+        double bound;                // fences reach this far from the goals
+        const Fence* fences;
+        int fence_num;
+        unsigned long long goals_hash;
+
+        FenceIndexFile();
+        FenceIndexFile(FenceIndexFile const &) = delete;
+        void operator=(FenceIndexFile const &x) = delete;
+        ~FenceIndexFile();
+
+        // Maps the file; goals_hash 0 accepts any goal set.  Returns false
+        // if the file can't be mapped, is truncated, was built for another
+        // mesh or goal set, or has a fence whose gid or root (of
+        // vertex_num) is out of range.
+        bool open(const std::string& path, unsigned long long mesh_hash,
+                  unsigned long long goals_hash, int vertex_num);
+        size_t get_size() const { return size; }
+};
+
+// FNV-1a over the goals and their alive flags.
+unsigned long long hash_goals(const std::vector<Point>& goals, const std::vector<char>& alive);
+
+bool save_fence_index(const std::string& path, unsigned long long mesh_hash,
+                      const std::vector<Point>& goals, const std::vector<char>& alive,
+                      const int* offsets, const std::vector<double>& first_ub,
+                      const std::vector<float>& rest_lb, int depth, double bound,
+                      FenceRange fences);
+
+}
@@ -1,11 +1,73 @@
 #include "knnMeshFence.h"
+#include "fenceindex.h"
 #include "expansion.h"
 #include "point.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
 
 using namespace std;
 
 namespace polyanya {
 
+// Passes the n fences of one edge again in lb order, with the rule of
+// pass_fence, dropping repeated ones; those kept are moved to the front and
+// counted, ub is the tightest ub seen.
+static int merge_fences(Fence* fs, int n, double& ub) {
+  sort(fs, fs + n, [](const Fence& a, const Fence& b) {
+    if (a.lb != b.lb) return a.lb < b.lb;
+    if (a.ub != b.ub) return a.ub < b.ub;
+    if (a.gid != b.gid) return a.gid < b.gid;
+    return a.root < b.root;
+  });
+  ub = fs[0].ub;
+  int kept = 1;
+  for (int i=1; i<n; i++) {
+    const Fence& prev = fs[kept-1];
+    const Fence& f = fs[i];
+    if (f.lb > ub) continue;
+    if (f.gid == prev.gid && f.lb == prev.lb && f.ub == prev.ub && f.root == prev.root) continue;
+    ub = min(ub, f.ub);
+    fs[kept++] = f;
+  }
+  return kept;
+}
+
+// Whether v of goal g is beaten by g itself or by depth other goals among
+// the n best values of distinct goals in val/gid, ascending.
+static bool beaten(const double* val, const int* gid, int n, int depth, double v, int g) {
+  int others = 0;
+  for (int i=0; i<n && val[i] < v; i++) {
+    if (gid[i] == g || ++others >= depth) return true;
+  }
+  return false;
+}
+
+// Records v of goal g, keeping the cap best values of distinct goals.
+static void record(double* val, int* gid, int& n, int cap, double v, int g) {
+  int i = 0;
+  while (i < n && gid[i] != g) i++;
+  if (i < n) {
+    if (val[i] <= v) return;
+    for (; i+1<n; i++) {
+      val[i] = val[i+1];
+      gid[i] = gid[i+1];
+    }
+    n--;
+  }
+  else if (n == cap) {
+    if (val[n-1] <= v) return;
+    n--;
+  }
+  int j = n++;
+  for (; j>0 && val[j-1] > v; j--) {
+    val[j] = val[j-1];
+    gid[j] = gid[j-1];
+  }
+  val[j] = v;
+  gid[j] = g;
+}
+
 int KnnMeshEdgeFence::succ_to_node(SearchNodePtr parent, Successor* successors, int num_succ, SearchNodePtr nodes, int gid) {
 
   assert(mesh != nullptr);
@@ -25,7 +87,10 @@ int KnnMeshEdgeFence::succ_to_node(SearchNodePtr parent, Successor* successors,
 
     // We implicitly set h to be zero and let search() update it.
     const auto process = [&](const int root, const double g) {
-      if (root != -1) {
+      if (root != -1 && deep()) {
+        if (!pass_root(root, g, gid)) return;
+      }
+      else if (root != -1) {
         assert(root >= 0 && root < (int) root_g_values.size());
         if (root_search_ids[root] != search_id) {
           // first time reaching root
@@ -68,7 +133,7 @@ int KnnMeshEdgeFence::succ_to_node(SearchNodePtr parent, Successor* successors,
   return out;
 }
 
-void KnnMeshEdgeFence::gen_initial_nodes() {
+void KnnMeshEdgeFence::gen_initial_nodes(int from, int to) {
   #define get_lazy(next, left, right, gid) new (node_pool->allocate()) SearchNode \
   {nullptr, -1, goals[gid], goals[gid], left, right, next, 0, 0}
   #define v(vertex) mesh->mesh_vertices[vertex]
@@ -119,7 +184,8 @@ void KnnMeshEdgeFence::gen_initial_nodes() {
     nodes_generated += num_nodes;
     nodes_pushed += num_nodes;
   };
-  for (int i=0; i<(int)goals.size(); i++) {
+  for (int i=from; i<to; i++) {
+    if (!goal_alive[i]) continue;
     const PointLocation pl = get_point_location_in_search(goals[i], mesh, verbose);
     switch(pl.type) {
       case PointLocation::NOT_ON_MESH:
@@ -178,10 +244,198 @@ void KnnMeshEdgeFence::floodfill() {
   assert(mesh != nullptr);
   init_floodfill();
   timer.start();
+  expand();
+  build_fences(false);
+  if (cluster_size > 0) build_coarse();
+  timer.stop();
+}
+
+void KnnMeshEdgeFence::floodfill(int threads) {
+  assert(mesh != nullptr);
+  threads = min(threads, (int)goals.size());
+  if (threads <= 1 || deep()) {
+    floodfill();
+    return;
+  }
+  timer.start();
+  // Goal gid goes to worker gid % threads, so the goals of every worker
+  // are spread over the whole mesh and each one fences off a similar area.
+  const int edge_num = mesh->edge_num;
+  vector<atomic<double>> shared(edge_num);
+  for (auto& ub: shared) ub.store(INF, memory_order_relaxed);
+  vector<KnnMeshEdgeFence*> workers;
+  for (int t=0; t<threads; t++) {
+    KnnMeshEdgeFence* w = new KnnMeshEdgeFence(mesh);
+    w->shared_ub = shared.data();
+    w->fine_bound = fine_bound;
+    vector<Point> gs;
+    vector<char> alive;
+    for (int gid=t; gid<(int)goals.size(); gid+=threads) {
+      gs.push_back(goals[gid]);
+      alive.push_back(goal_alive[gid]);
+    }
+    w->set_goals(gs);
+    w->goal_alive = alive;
+    workers.push_back(w);
+  }
+  const auto run = [](KnnMeshEdgeFence* w) {
+    w->init_floodfill();
+    w->expand();
+  };
+  vector<thread> pool;
+  for (int t=1; t<threads; t++) pool.emplace_back(run, workers[t]);
+  run(workers[0]);
+  for (thread& th: pool) th.join();
+
+  nodes_generated = nodes_pushed = nodes_popped = nodes_pruned = nodes_intermediate = 0;
+  // the g values of the roots stayed in the workers
+  search_id++;
+  rest_lb.clear();
+  flood_bound = fence_bound = fine_bound;
+  passed.clear();
+  passed_edge.clear();
+  first_ub.assign(mesh->edge_num, INF);
+  for (int t=0; t<threads; t++) {
+    KnnMeshEdgeFence* w = workers[t];
+    nodes_generated += w->nodes_generated;
+    nodes_pushed += w->nodes_pushed;
+    nodes_popped += w->nodes_popped;
+    nodes_pruned += w->nodes_pruned;
+    nodes_intermediate += w->nodes_intermediate;
+    for (size_t i=0; i<w->passed.size(); i++) {
+      Fence f = w->passed[i];
+      f.gid = f.gid * threads + t;
+      passed.push_back(f);
+      passed_edge.push_back(w->passed_edge[i]);
+    }
+    delete w;
+  }
+  build_fences(true);
+  if (cluster_size > 0) build_coarse();
+  timer.stop();
+}
+
+int KnnMeshEdgeFence::add_goal(const Point& p) {
+  assert(mesh != nullptr);
+  const int gid = goals.size();
+  goals.push_back(p);
+  goal_alive.push_back(1);
+  if (lazy) {
+    reset_lazy();
+    return gid;
+  }
+  if (deep()) {
+    floodfill();
+    return gid;
+  }
+  timer.start();
+  // first_ub and the g values of the roots are still those of the last
+  // floodfill, so the new goal stops where the other goals are nearer.
+  unpack_fences(-1);
+  repair({gid}, false);
+  if (cluster_size > 0) build_coarse();
+  timer.stop();
+  return gid;
+}
+
+void KnnMeshEdgeFence::remove_goal(int gid) {
+  assert(mesh != nullptr);
+  assert(gid >= 0 && gid < (int)goals.size() && goal_alive[gid]);
+  goal_alive[gid] = 0;
+  if (lazy) {
+    reset_lazy();
+    return;
+  }
+  if (deep()) {
+    floodfill();
+    return;
+  }
+  timer.start();
+  const int edge_num = mesh->edge_num;
+  const int nump = mesh->mesh_polygons.size();
+  vector<char> owned(edge_num, 0);
+  for (int e=0; e<edge_num; e++)
+    for (const Fence& f: get_fences(e))
+      if (f.gid == gid) owned[e] = 1;
+
+  // The goals whose floodfill gid may have stopped: those with fences on
+  // the polygons around the edges gid fenced, or lying in them.
+  vector<char> near_edge(edge_num, 0);
+  vector<int> near_polys;
+  double minx = INF, maxx = -INF, miny = INF, maxy = -INF;
+  for (int i=0; i<nump; i++) {
+    const Polygon& poly = mesh->mesh_polygons[i];
+    bool near = false;
+    for (int e: poly.edges) near = near || owned[e];
+    if (!near) continue;
+    near_polys.push_back(i);
+    for (int e: poly.edges) near_edge[e] = 1;
+    minx = min(minx, poly.min_x); maxx = max(maxx, poly.max_x);
+    miny = min(miny, poly.min_y); maxy = max(maxy, poly.max_y);
+  }
+  vector<char> is_near(goals.size(), 0);
+  for (int e=0; e<edge_num; e++)
+    if (near_edge[e])
+      for (const Fence& f: get_fences(e)) is_near[f.gid] = 1;
+  if (!near_polys.empty()) {
+    vector<char> in_near(nump, 0);
+    for (int i: near_polys) in_near[i] = 1;
+    for (int g=0; g<(int)goals.size(); g++) {
+      const Point& p = goals[g];
+      if (!goal_alive[g] || is_near[g] || p.x < minx || p.x > maxx || p.y < miny || p.y > maxy) continue;
+      const PointLocation pl = get_point_location_in_search(goals[g], mesh, verbose);
+      if ((pl.poly1 != -1 && in_near[pl.poly1]) || (pl.poly2 != -1 && in_near[pl.poly2])) is_near[g] = 1;
+    }
+  }
+  is_near[gid] = 0;
+  vector<int> gids;
+  for (int g=0; g<(int)goals.size(); g++)
+    if (is_near[g]) gids.push_back(g);
+
+  // Those goals expand again from scratch against the remaining fences;
+  // the fences they pass again are merged away as repeats.
+  unpack_fences(gid);
+  for (int e=0; e<edge_num; e++) first_ub[e] = INF;
+  for (size_t i=0; i<passed.size(); i++)
+    first_ub[passed_edge[i]] = min(first_ub[passed_edge[i]], passed[i].ub);
+  repair(gids, true);
+  if (cluster_size > 0) build_coarse();
+  timer.stop();
+}
 
+void KnnMeshEdgeFence::unpack_fences(int skip_gid) {
+  passed.clear();
+  passed_edge.clear();
+  for (int e=0; e<mesh->edge_num; e++) {
+    for (const Fence& f: get_fences(e)) {
+      if (f.gid == skip_gid) continue;
+      passed.push_back(f);
+      passed_edge.push_back(e);
+    }
+  }
+}
+
+void KnnMeshEdgeFence::repair(const vector<int>& gids, bool fresh_roots) {
+  node_pool->reclaim();
+  if (fresh_roots) search_id++;
+  open_list = pq();
+  nodes_generated = 0;
+  nodes_pushed = 0;
+  nodes_popped = 0;
+  nodes_pruned = 0;
+  nodes_intermediate = 0;
+  flood_bound = fence_bound;
+  for (int gid: gids) gen_initial_nodes(gid, gid + 1);
+  expand();
+  build_fences(true);
+}
+
+void KnnMeshEdgeFence::expand() {
   while (!open_list.empty()) {
     FloodFillNode fnode = open_list.top(); open_list.pop();
     SearchNodePtr snode = fnode.snode;
+    // the open list is in lb order, so everything left is beyond the bound
+    if (fnode.lb > flood_bound) break;
 
     if (!pass_fence(fnode))
       continue;
@@ -201,7 +455,7 @@ void KnnMeshEdgeFence::floodfill() {
     if (root != -1) {
       assert(root < (int) root_g_values.size());
       if (root_search_ids[root] == search_id) {
-        if (root_g_values[root] + EPSILON < snode->g) {
+        if (deep()? root_beaten(root, snode->g, fnode.gid): root_g_values[root] + EPSILON < snode->g) {
             nodes_pruned++;
             #ifndef NDEBUG
             if (verbose) std::cerr << "node is dominated!" << std::endl;
@@ -210,19 +464,53 @@ void KnnMeshEdgeFence::floodfill() {
         }
       }
     }
+    // lb/ub of an interval generated by the floodfill from goal gid.
+    const auto get_bounds = [&](SearchNode& nxt, double& lb, double& ub) {
+      const Point& nxt_root = (nxt.root == -1? start: mesh->mesh_vertices[nxt.root].p);
+      nxt.f += get_interval_heuristic(nxt_root, nxt.left, nxt.right);
+      const Point& left = mesh->mesh_vertices[nxt.left_vertex].p;
+      const Point& right = mesh->mesh_vertices[nxt.right_vertex].p;
+      lb = nxt.f;
+      ub = nxt.g + max(nxt_root.distance(nxt.left) + nxt.left.distance(left), nxt_root.distance(nxt.right) + nxt.right.distance(right));
+    };
+
+    int num_nodes = 1;
     search_nodes_to_push[0] = *snode;
-    SearchNode cur = search_nodes_to_push[0];
-    int num_succ = get_successors(search_nodes_to_push[0], start, *mesh, search_successors);
-    int num_nodes = succ_to_node(&cur, search_successors, num_succ, search_nodes_to_push, fnode.gid);
+    // Intermediate pruning: follow single-successor corridors inline,
+    // only checking the fence of each edge crossed instead of pushing
+    // every interval onto the open list.
+    do {
+      SearchNode cur = search_nodes_to_push[0];
+      int num_succ = get_successors(cur, start, *mesh, search_successors);
+      num_nodes = succ_to_node(&cur, search_successors, num_succ, search_nodes_to_push, fnode.gid);
+      if (num_nodes == 1) {
+        double lb, ub;
+        SearchNode& nxt = search_nodes_to_push[0];
+        get_bounds(nxt, lb, ub);
+        // past the bound, as for the nodes popped off the open list
+        if (lb > flood_bound ||
+            !pass_fence(FloodFillNode(&nxt, lb, ub, fnode.gid, cur.next_polygon, -1))) {
+          num_nodes = 0;
+          break;
+        }
+        nodes_intermediate++;
+        // the next expansion starts from nxt with h reset
+        nxt.f = nxt.g;
+        #ifndef NDEBUG
+        if (verbose) {
+          std::cerr << "\tintermediate: ";
+          print_node(FloodFillNode(&nxt, lb, ub, fnode.gid, cur.next_polygon, -1), std::cerr);
+          std::cerr << std::endl;
+        }
+        #endif
+      }
+    } while (num_nodes == 1); // if num_nodes == 0, we still break
+
     for (int i=0; i<num_nodes; i++) {
       const SearchNodePtr nxt = new (node_pool->allocate()) SearchNode(search_nodes_to_push[i]);
-      const Point& nxt_root = (nxt->root == -1? start: mesh->mesh_vertices[nxt->root].p);
-      nxt->f += get_interval_heuristic(nxt_root, nxt->left, nxt->right);
       nxt->parent = snode;
-      const Point& left = mesh->mesh_vertices[nxt->left_vertex].p;
-      const Point& right = mesh->mesh_vertices[nxt->right_vertex].p;
-      double lb = nxt->f;
-      double ub = nxt->g + max(nxt_root.distance(nxt->left) + nxt->left.distance(left), nxt_root.distance(nxt->right) + nxt->right.distance(right));
+      double lb, ub;
+      get_bounds(*nxt, lb, ub);
       FloodFillNode nxt_fnode = FloodFillNode(nxt, lb, ub, fnode.gid,
           snode->next_polygon, search_successors[i].poly_left_ind);
 
@@ -237,30 +525,580 @@ void KnnMeshEdgeFence::floodfill() {
       nodes_generated++;
     }
   }
-  timer.stop();
+}
+
+void KnnMeshEdgeFence::build_fences(bool by_lb) {
+  // counting sort of the passed fences by edge, stable within an edge
+  const int edge_num = mesh->edge_num;
+  fence_offset.assign(edge_num + 1, 0);
+  for (int e: passed_edge) fence_offset[e+1]++;
+  active_edges = 0;
+  for (int e=0; e<edge_num; e++) {
+    active_edges += fence_offset[e+1] > 0;
+    fence_offset[e+1] += fence_offset[e];
+  }
+  vector<int> pos(fence_offset.begin(), fence_offset.end() - 1);
+  fences.resize(passed.size());
+  for (size_t i=0; i<passed.size(); i++) fences[pos[passed_edge[i]]++] = passed[i];
+  // Fences merged from several floodfills are passed again in lb order
+  // (merge_fences).  A fence was passed against the ub known at the time;
+  // those whose lb exceeds the final one never give the minimum on the
+  // edge and are dropped.
+  int out = 0;
+  for (int e=0; e<edge_num; e++) {
+    int first = fence_offset[e], last = fence_offset[e+1];
+    fence_offset[e] = out;
+    if (first == last) {
+      if (by_lb) first_ub[e] = INF;
+      continue;
+    }
+    if (by_lb) last = first + merge_fences(&fences[first], last - first, first_ub[e]);
+    for (int i=first; i<last; i++) {
+      if (i > first && fences[i].lb > first_ub[e]) continue;
+      fences[out++] = fences[i];
+    }
+  }
+  fence_offset[edge_num] = out;
+  fences_dropped = fences.size() - out;
+  fences.resize(out);
+  if (fence_budget > 0) cap_fences();
+  sort_by_key(fence_offset, fences);
+  fences.shrink_to_fit();
+  use_built();
+  fenceCnt = fences.size();
+  vector<Fence>().swap(passed);
+  vector<int>().swap(passed_edge);
+  vector<double>().swap(top_val);
+  vector<int>().swap(top_gid);
+  vector<int>().swap(top_num);
+  vector<double>().swap(root_top_val);
+  vector<int>().swap(root_top_gid);
+  vector<int>().swap(root_top_num);
+}
+
+void KnnMeshEdgeFence::cap_fences() {
+  // Any path through edge e to the goal of a dropped fence f is at least
+  // f.g + |root of f, e| long past the edge, so rest_lb keeps the
+  // heuristic admissible.  Bounds of earlier builds are kept: after an
+  // update they may belong to goals that are gone, which only makes them
+  // lower.
+  const int edge_num = mesh->edge_num;
+  if ((int)rest_lb.size() != edge_num) rest_lb.assign(edge_num, INFINITY);
+  const auto lb_order = [](const Fence& a, const Fence& b) { return a.lb < b.lb; };
+  fences_capped = 0;
+  capped_edges = 0;
+  int out = 0;
+  for (int e=0; e<edge_num; e++) {
+    int first = fence_offset[e], last = fence_offset[e+1];
+    fence_offset[e] = out;
+    if (last - first > fence_budget) {
+      sort(fences.begin() + first, fences.begin() + last, lb_order);
+      const Point& a = mesh->mesh_vertices[mesh->edge_vertices[e].first].p;
+      const Point& b = mesh->mesh_vertices[mesh->edge_vertices[e].second].p;
+      double rest = INF;
+      for (int i=first+fence_budget; i<last; i++) {
+        const Fence& f = fences[i];
+        const Point& inner = f.root == -1? goals[f.gid]: mesh->mesh_vertices[f.root].p;
+        rest = min(rest, f.g + inner.distance_to_seg(a, b));
+      }
+      float down = (float)rest;
+      if (down > rest) down = nextafterf(down, -INFINITY);
+      rest_lb[e] = min(rest_lb[e], down);
+      fences_capped += last - first - fence_budget;
+      capped_edges++;
+      last = first + fence_budget;
+    }
+    for (int i=first; i<last; i++) fences[out++] = fences[i];
+  }
+  fence_offset[edge_num] = out;
+  fences.resize(out);
+}
+
+void KnnMeshEdgeFence::sort_by_key(vector<int>& offset, vector<Fence>& fs) const {
+  const auto key_order = [](const Fence& a, const Fence& b) { return a.key < b.key; };
+  for (size_t i=0; i+1<offset.size(); i++)
+    sort(fs.begin() + offset[i], fs.begin() + offset[i+1], key_order);
+}
+
+void KnnMeshEdgeFence::use_built() {
+  offset_data = fence_offset.data();
+  fence_data = fences.data();
+  fence_total = fences.size();
+  mapped.reset();
+}
+
+bool KnnMeshEdgeFence::save_fences(const string& path) const {
+  return save_fence_index(path, mesh->get_hash(), goals, goal_alive, offset_data,
+                          first_ub, rest_lb, fence_depth, fence_bound, get_all_fences());
+}
+
+bool KnnMeshEdgeFence::load_fences(const string& path, unsigned long long goals_hash) {
+  shared_ptr<FenceIndexFile> file = make_shared<FenceIndexFile>();
+  if (!file->open(path, mesh->get_hash(), goals_hash, mesh->mesh_vertices.size()) ||
+      file->edge_num != mesh->edge_num)
+    return false;
+  goals.assign(file->goals, file->goals + file->goal_num);
+  goal_alive.assign(file->alive, file->alive + file->goal_num);
+  first_ub.assign(file->first_ub, file->first_ub + file->edge_num);
+  rest_lb.assign(file->rest_lb, file->rest_lb + file->rest_num);
+  fence_depth = file->depth;
+  fence_bound = file->bound;
+  vector<int>().swap(fence_offset);
+  vector<Fence>().swap(fences);
+  offset_data = file->offsets;
+  fence_data = file->fences;
+  fence_total = file->fence_num;
+  mapped = file;
+  fenceCnt = fence_total;
+  fences_dropped = 0;
+  active_edges = 0;
+  for (int e=0; e<mesh->edge_num; e++) active_edges += get_fence_num(e) > 0;
+  // no g values of roots come with the file
+  search_id++;
+  nodes_generated = nodes_pushed = nodes_popped = nodes_pruned = nodes_intermediate = 0;
+  if (cluster_size > 0) build_coarse();
+  return true;
 }
 
 bool KnnMeshEdgeFence::pass_fence(const FloodFillNode& fnode) {
-  int left_vid = fnode.snode->left_vertex;
-  int right_vid = fnode.snode->right_vertex;
-  pair<int, int> key = {min(left_vid, right_vid), max(left_vid, right_vid)};
-  if (fences[key].empty()) {
-    Fence fence(fnode.lb, fnode.ub, fnode.gid, fnode.snode);
-    fences[key].push_back(fence);
-    fenceCnt++;
-    return true;
-  }
-  else {
-    assert(fences[key][0].lb <= fnode.lb);
-    if (fnode.lb <= fences[key][0].ub) {
-      fences[key][0].ub = min(fnode.ub, fences[key][0].ub);
-      Fence fence(fnode.lb, fnode.ub, fnode.gid, fnode.snode);
-      fences[key].push_back(fence);
-      fenceCnt++;
-      return true;
+  const int edge = mesh->get_edge(fnode.snode->next_polygon, fnode.snode->left_vertex, fnode.snode->right_vertex);
+  assert(edge != -1);
+  double& ub = first_ub[edge];
+  if (deep()) {
+    const int cap = fence_depth + 1;
+    double* val = &top_val[edge * cap];
+    int* gid = &top_gid[edge * cap];
+    if (beaten(val, gid, top_num[edge], fence_depth, fnode.lb, fnode.gid)) return false;
+    record(val, gid, top_num[edge], cap, fnode.ub, fnode.gid);
+  }
+  else if (shared_ub) {
+    // Same rule against the ub of all workers.  Which fences a worker
+    // passes depends on timing, but all it drops are dominated.
+    atomic<double>& s = shared_ub[edge];
+    double cur = s.load(memory_order_relaxed);
+    if (cur != INF && fnode.lb > cur) return false;
+    while (fnode.ub < cur && !s.compare_exchange_weak(cur, fnode.ub, memory_order_relaxed));
+    ub = min(ub, fnode.ub);
+  }
+  else if (ub == INF) {
+    ub = fnode.ub;
+  }
+  // Intervals reached inline through a corridor are not popped in lb
+  // order, so the first fence only keeps the tightest ub seen so far;
+  // the dominance test itself does not depend on the order.
+  else if (fnode.lb <= ub) {
+    ub = min(fnode.ub, ub);
+  }
+  else return false;
+  passed.push_back(make_fence(fnode));
+  passed_edge.push_back(edge);
+  return true;
+}
+
+bool KnnMeshEdgeFence::pass_root(int root, double g, int gid) {
+  const int cap = fence_depth + 1;
+  if (root_search_ids[root] != search_id) {
+    root_search_ids[root] = search_id;
+    root_top_num[root] = 0;
+  }
+  else if (root_beaten(root, g, gid)) return false;
+  record(&root_top_val[root * cap], &root_top_gid[root * cap], root_top_num[root], cap, g, gid);
+  return true;
+}
+
+bool KnnMeshEdgeFence::root_beaten(int root, double g, int gid) const {
+  const int cap = fence_depth + 1;
+  return beaten(&root_top_val[root * cap], &root_top_gid[root * cap], root_top_num[root],
+                fence_depth, g - EPSILON, gid);
+}
+
+Fence KnnMeshEdgeFence::make_fence(const FloodFillNode& fnode) const {
+  const SearchNode& s = *fnode.snode;
+  const int a = min(s.left_vertex, s.right_vertex), b = max(s.left_vertex, s.right_vertex);
+  const Point& p = mesh->mesh_vertices[a].p;
+  const Point d = mesh->mesh_vertices[b].p - p;
+  const double len2 = d.dot(d);
+  const auto param = [&](const Point& q) {
+    return len2 > 0? (float)((q - p).dot(d) / len2): 0.0f;
+  };
+  const Point& inner = s.root == -1? goals[fnode.gid]: mesh->mesh_vertices[s.root].p;
+  const double key = s.g + inner.distance_to_seg(p, mesh->mesh_vertices[b].p);
+  float down = (float)key;
+  if (down > key) down = nextafterf(down, -INFINITY);
+  return {fnode.lb, fnode.ub, s.g, s.root, fnode.gid, param(s.left), param(s.right), down};
+}
+
+void KnnMeshEdgeFence::set_hierarchy(int size, double bound) {
+  cluster_size = max(0, size);
+  fine_bound = cluster_size > 0? bound: INF;
+  poly_cluster.clear();
+  portal_offset.clear();
+  portals.clear();
+  coarse_offset.clear();
+  coarse.clear();
+  if (cluster_size == 0) return;
+  // clusters grown breadth first from the lowest unassigned polygon
+  const int nump = mesh->mesh_polygons.size();
+  poly_cluster.assign(nump, -1);
+  int clusters = 0;
+  vector<int> queue;
+  for (int i=0; i<nump; i++) {
+    if (poly_cluster[i] != -1) continue;
+    queue.assign(1, i);
+    poly_cluster[i] = clusters;
+    for (size_t head=0; head<queue.size() && (int)queue.size() < cluster_size; head++) {
+      for (int q: mesh->mesh_polygons[queue[head]].polygons) {
+        if (q == -1 || poly_cluster[q] != -1 || (int)queue.size() >= cluster_size) continue;
+        poly_cluster[q] = clusters;
+        queue.push_back(q);
+      }
     }
+    clusters++;
   }
-  return false;
+  // edges between polygons of different clusters, by cluster
+  portal_offset.assign(clusters + 1, 0);
+  vector<pair<int, int>> cluster_edge;
+  for (int i=0; i<nump; i++) {
+    const Polygon& poly = mesh->mesh_polygons[i];
+    for (size_t j=0; j<poly.polygons.size(); j++) {
+      const int q = poly.polygons[j];
+      if (q == -1 || poly_cluster[q] == poly_cluster[i]) continue;
+      cluster_edge.push_back({poly_cluster[i], poly.edges[j]});
+    }
+  }
+  sort(cluster_edge.begin(), cluster_edge.end());
+  cluster_edge.erase(unique(cluster_edge.begin(), cluster_edge.end()), cluster_edge.end());
+  for (const auto& ce: cluster_edge) {
+    portal_offset[ce.first+1]++;
+    portals.push_back(ce.second);
+  }
+  for (int c=0; c<clusters; c++) portal_offset[c+1] += portal_offset[c];
+}
+
+void KnnMeshEdgeFence::build_coarse() {
+  // A path from a point of a cluster leaves it through one of its portals,
+  // and between two portals it crosses a cluster both lie on, so it is at
+  // least as long as the distance between the two segments.
+  const int edge_num = mesh->edge_num;
+  const int clusters = get_cluster_num();
+  const auto end = [&](int e, bool second) -> const Point& {
+    const pair<int, int>& v = mesh->edge_vertices[e];
+    return mesh->mesh_vertices[second? v.second: v.first].p;
+  };
+  const auto seg_dist = [&](int e, int f) {
+    const Point &a = end(e, false), &b = end(e, true), &c = end(f, false), &d = end(f, true);
+    return min(min(a.distance_to_seg(c, d), b.distance_to_seg(c, d)),
+               min(c.distance_to_seg(a, b), d.distance_to_seg(a, b)));
+  };
+  // the clusters of every portal
+  vector<int> side(2 * edge_num, -1);
+  for (int c=0; c<clusters; c++)
+    for (int i=portal_offset[c]; i<portal_offset[c+1]; i++) {
+      const int e = portals[i];
+      side[2*e + (side[2*e] != -1)] = c;
+    }
+
+  vector<double> d(edge_num, INF);
+  vector<int> src(edge_num, -1);
+  priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> q;
+  vector<pair<int, int>> cluster_goal;
+  for (int g=0; g<(int)goals.size(); g++) {
+    if (!goal_alive[g]) continue;
+    const PointLocation pl = get_point_location_in_search(goals[g], mesh, verbose);
+    vector<int> polys;
+    switch (pl.type) {
+      case PointLocation::NOT_ON_MESH:
+        break;
+      case PointLocation::ON_EDGE:
+        polys = {pl.poly1, pl.poly2};
+        break;
+      case PointLocation::ON_CORNER_VERTEX_AMBIG:
+      case PointLocation::ON_CORNER_VERTEX_UNAMBIG:
+      case PointLocation::ON_NON_CORNER_VERTEX:
+        polys = mesh->mesh_vertices[pl.vertex1].polygons;
+        break;
+      default:
+        polys = {pl.poly1};
+        break;
+    }
+    vector<int> cs;
+    for (int poly: polys)
+      if (poly != -1) cs.push_back(poly_cluster[poly]);
+    sort(cs.begin(), cs.end());
+    cs.erase(unique(cs.begin(), cs.end()), cs.end());
+    for (int c: cs) {
+      cluster_goal.push_back({c, g});
+      for (int i=portal_offset[c]; i<portal_offset[c+1]; i++) {
+        const int e = portals[i];
+        const double v = goals[g].distance_to_seg(end(e, false), end(e, true));
+        if (v < d[e]) {
+          d[e] = v;
+          src[e] = g;
+          q.push({v, e});
+        }
+      }
+    }
+  }
+  while (!q.empty()) {
+    const pair<double, int> top = q.top(); q.pop();
+    const int e = top.second;
+    if (top.first > d[e]) continue;
+    for (int s=0; s<2; s++) {
+      const int c = side[2*e + s];
+      if (c == -1) continue;
+      for (int i=portal_offset[c]; i<portal_offset[c+1]; i++) {
+        const int f = portals[i];
+        const double v = d[e] + seg_dist(e, f);
+        if (v < d[f]) {
+          d[f] = v;
+          src[f] = src[e];
+          q.push({v, f});
+        }
+      }
+    }
+  }
+
+  // coarse fences of each cluster: its goals, then its portals, by d
+  coarse_offset.assign(clusters + 1, 0);
+  coarse.clear();
+  sort(cluster_goal.begin(), cluster_goal.end());
+  size_t next_goal = 0;
+  for (int c=0; c<clusters; c++) {
+    coarse_offset[c] = coarse.size();
+    for (; next_goal < cluster_goal.size() && cluster_goal[next_goal].first == c; next_goal++)
+      coarse.push_back({0, -1, cluster_goal[next_goal].second});
+    for (int i=portal_offset[c]; i<portal_offset[c+1]; i++)
+      if (d[portals[i]] < INF) coarse.push_back({d[portals[i]], portals[i], src[portals[i]]});
+    sort(coarse.begin() + coarse_offset[c], coarse.end(),
+         [](const CoarseFence& a, const CoarseFence& b) { return a.d < b.d; });
+  }
+  coarse_offset[clusters] = coarse.size();
+  coarse.shrink_to_fit();
+}
+
+double KnnMeshEdgeFence::get_coarse_bound(int poly, const Point& root, double base, int& gid) const {
+  const int c = poly_cluster[poly];
+  double best = INF;
+  gid = -1;
+  for (int i=coarse_offset[c]; i<coarse_offset[c+1]; i++) {
+    const CoarseFence& f = coarse[i];
+    if (base + f.d >= best) break;
+    double to;
+    if (f.edge == -1) {
+      to = root.distance(goals[f.gid]);
+    } else {
+      const pair<int, int>& v = mesh->edge_vertices[f.edge];
+      to = root.distance_to_seg(mesh->mesh_vertices[v.first].p, mesh->mesh_vertices[v.second].p);
+    }
+    const double h = max(base, to) + f.d;
+    if (h < best) {
+      best = h;
+      gid = f.gid;
+    }
+  }
+  return best;
+}
+
+void KnnMeshEdgeFence::set_lazy(int grid, size_t capacity, int near_goals) {
+  lazy = grid > 0;
+  lazy_capacity = capacity;
+  lazy_near = max(1, near_goals);
+  regions.clear();
+  edge_region.clear();
+  edge_slot.clear();
+  if (!lazy) return;
+  coarse_offset.clear();
+  coarse.clear();
+  double minx = INF, maxx = -INF, miny = INF, maxy = -INF;
+  for (const Vertex& v: mesh->mesh_vertices) {
+    minx = min(minx, v.p.x); maxx = max(maxx, v.p.x);
+    miny = min(miny, v.p.y); maxy = max(maxy, v.p.y);
+  }
+  const auto cell = [&](double x, double lo, double hi) {
+    if (hi <= lo) return 0;
+    return max(0, min(grid - 1, (int)((x - lo) / (hi - lo) * grid)));
+  };
+  regions.resize(grid * grid);
+  for (LazyRegion& reg: regions) {
+    reg.minx = reg.miny = INF;
+    reg.maxx = reg.maxy = -INF;
+  }
+  const int edge_num = mesh->edge_num;
+  edge_region.resize(edge_num);
+  edge_slot.resize(edge_num);
+  for (int e=0; e<edge_num; e++) {
+    const Point& a = mesh->mesh_vertices[mesh->edge_vertices[e].first].p;
+    const Point& b = mesh->mesh_vertices[mesh->edge_vertices[e].second].p;
+    const int r = cell((a.y + b.y) / 2, miny, maxy) * grid + cell((a.x + b.x) / 2, minx, maxx);
+    LazyRegion& reg = regions[r];
+    edge_region[e] = r;
+    edge_slot[e] = reg.edges.size();
+    reg.edges.push_back(e);
+    reg.minx = min(reg.minx, min(a.x, b.x)); reg.maxx = max(reg.maxx, max(a.x, b.x));
+    reg.miny = min(reg.miny, min(a.y, b.y)); reg.maxy = max(reg.maxy, max(a.y, b.y));
+  }
+  reset_lazy();
+}
+
+void KnnMeshEdgeFence::reset_lazy() {
+  for (LazyRegion& reg: regions) {
+    reg.seen = reg.warm = reg.requested = false;
+    reg.last_used = 0;
+    vector<int>().swap(reg.near_goals);
+    vector<int>().swap(reg.offset);
+    vector<Fence>().swap(reg.fences);
+  }
+  requested.clear();
+  lazy_cached = 0;
+  lazy_clock = 0;
+}
+
+void KnnMeshEdgeFence::see_region(LazyRegion& reg) {
+  vector<pair<double, int>> dist;
+  for (int g=0; g<(int)goals.size(); g++) {
+    if (!goal_alive[g]) continue;
+    const Point& p = goals[g];
+    const double dx = max(0.0, max(reg.minx - p.x, p.x - reg.maxx));
+    const double dy = max(0.0, max(reg.miny - p.y, p.y - reg.maxy));
+    dist.push_back({sqrt(dx * dx + dy * dy), g});
+  }
+  reg.seen = true;
+  reg.cold_lb = INF;
+  reg.cold_gid = -1;
+  reg.bound = INF;
+  reg.near_goals.clear();
+  const int n = min((int)dist.size(), lazy_near);
+  if (n < (int)dist.size()) {
+    nth_element(dist.begin(), dist.begin() + n, dist.end());
+    reg.bound = dist[n].first;
+  }
+  for (int i=0; i<n; i++) {
+    reg.near_goals.push_back(dist[i].second);
+    if (dist[i].first < reg.cold_lb) {
+      reg.cold_lb = dist[i].first;
+      reg.cold_gid = dist[i].second;
+    }
+  }
+}
+
+FenceRange KnnMeshEdgeFence::get_lazy_fences(int edge, double& rest, int& rest_gid) {
+  const int r = edge_region[edge];
+  LazyRegion& reg = regions[r];
+  if (!reg.seen) see_region(reg);
+  reg.last_used = ++lazy_clock;
+  rest_gid = reg.cold_gid;
+  if (!reg.warm) {
+    // Euclidean distance to the nearest goal until the region is built
+    if (!reg.requested) {
+      reg.requested = true;
+      requested.push_back(r);
+    }
+    rest = reg.cold_lb;
+    return {nullptr, nullptr};
+  }
+  rest = reg.bound;
+  const int i = edge_slot[edge];
+  return {reg.fences.data() + reg.offset[i], reg.fences.data() + reg.offset[i+1]};
+}
+
+void KnnMeshEdgeFence::build_regions(const vector<int>& rs) {
+  // One floodfill from the near goals of all the regions, bounded by the
+  // largest of their bounds.  Goals left out of it are at least bound away
+  // from every edge of a region, and so is anything beyond the nodes left
+  // on the open list, so bound is what FenceHeuristic falls back to past
+  // the fences of the region.
+  node_pool->reclaim();
+  search_id++;
+  open_list = pq();
+  nodes_generated = 0;
+  nodes_pushed = 0;
+  nodes_popped = 0;
+  nodes_pruned = 0;
+  nodes_intermediate = 0;
+  passed.clear();
+  passed_edge.clear();
+  first_ub.assign(mesh->edge_num, INF);
+  vector<char> start(goals.size(), 0);
+  flood_bound = 0;
+  for (int r: rs) {
+    for (int gid: regions[r].near_goals) start[gid] = 1;
+    flood_bound = max(flood_bound, regions[r].bound);
+  }
+  for (int gid=0; gid<(int)goals.size(); gid++)
+    if (start[gid]) gen_initial_nodes(gid, gid + 1);
+  expand();
+  flood_bound = INF;
+
+  // the fences on the edges of each region, by edge, then as build_fences
+  vector<char> building(regions.size(), 0);
+  for (int r: rs) {
+    LazyRegion& reg = regions[r];
+    reg.offset.assign(reg.edges.size() + 1, 0);
+    building[r] = 1;
+  }
+  for (int e: passed_edge)
+    if (building[edge_region[e]]) regions[edge_region[e]].offset[edge_slot[e]+1]++;
+  vector<vector<int>> pos(regions.size());
+  for (int r: rs) {
+    LazyRegion& reg = regions[r];
+    for (size_t i=0; i<reg.edges.size(); i++) reg.offset[i+1] += reg.offset[i];
+    pos[r].assign(reg.offset.begin(), reg.offset.end() - 1);
+    reg.fences.resize(reg.offset.back());
+  }
+  for (size_t i=0; i<passed.size(); i++) {
+    const int e = passed_edge[i], r = edge_region[e];
+    if (building[r]) regions[r].fences[pos[r][edge_slot[e]]++] = passed[i];
+  }
+  for (int r: rs) {
+    LazyRegion& reg = regions[r];
+    const int n = reg.edges.size();
+    int out = 0;
+    for (int i=0; i<n; i++) {
+      const int first = reg.offset[i], last = reg.offset[i+1];
+      reg.offset[i] = out;
+      if (first == last) continue;
+      double ub;
+      const int kept = merge_fences(&reg.fences[first], last - first, ub);
+      for (int j=first; j<first+kept; j++) {
+        if (j > first && reg.fences[j].lb > ub) continue;
+        reg.fences[out++] = reg.fences[j];
+      }
+    }
+    reg.offset[n] = out;
+    reg.fences.resize(out);
+    sort_by_key(reg.offset, reg.fences);
+    reg.fences.shrink_to_fit();
+    reg.warm = true;
+    lazy_cached += out;
+  }
+  passed.clear();
+  passed_edge.clear();
+}
+
+void KnnMeshEdgeFence::warm_up() {
+  if (requested.empty()) return;
+  timer.start();
+  build_regions(requested);
+  lazy_built += requested.size();
+  // least recently used first, never one just built
+  while (lazy_cached > lazy_capacity) {
+    int victim = -1;
+    for (int r=0; r<(int)regions.size(); r++) {
+      const LazyRegion& reg = regions[r];
+      if (reg.warm && !reg.requested && (victim == -1 || reg.last_used < regions[victim].last_used))
+        victim = r;
+    }
+    if (victim == -1) break;
+    LazyRegion& reg = regions[victim];
+    lazy_cached -= reg.fences.size();
+    reg.warm = false;
+    vector<int>().swap(reg.offset);
+    vector<Fence>().swap(reg.fences);
+    lazy_evicted++;
+  }
+  for (int r: requested) regions[r].requested = false;
+  requested.clear();
+  timer.stop();
 }
 
 void KnnMeshEdgeFence::print_node(const FloodFillNode& fnode, ostream& outfile) {
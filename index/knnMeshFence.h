@@ -7,25 +7,39 @@
 #include "successor.h"
 #include "point.h"
 #include <queue>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <string>
 
 using namespace std;
 
 namespace polyanya {
 
+// What the heuristic needs of a floodfill interval reaching an edge: the
+// goal, the root it is seen from and g of the root.  The interval itself is
+// kept as two parameters along the edge, 0 at the end vertex with the lower
+// id and 1 at the other (see KnnMeshEdgeFence::get_interval).
 struct Fence {
   double lb, ub;
+  double g;
+  int root;           // vertex id, -1 if the goal itself is the root
   int gid;
-  SearchNode s;
-  Fence(double l, double r, int gid,  SearchNodePtr sn): lb(l), ub(r), gid(gid) {
-    s.parent = nullptr;
-    s.root = sn->root;
-    s.g = sn->g;
-    s.f = sn->f;
-    s.left = sn->left;
-    s.right = sn->right;
-    s.left_vertex = sn->left_vertex;
-    s.right_vertex = sn->right_vertex;
-  };
+  float left, right;
+  // g + |root, edge| rounded down; the fences of an edge are kept in key
+  // order, so a scan for the smallest heuristic can stop early.
+  float key;
+};
+
+// Read-only view of the fences of one edge, valid until the next floodfill.
+struct FenceRange {
+  const Fence* first;
+  const Fence* last;
+  const Fence* begin() const { return first; }
+  const Fence* end() const { return last; }
+  int size() const { return last - first; }
+  bool empty() const { return first == last; }
+  const Fence& operator[](int i) const { return first[i]; }
 };
 
 
@@ -53,21 +67,104 @@ public:
   }
 };
 
+class FenceIndexFile;
+
 class KnnMeshEdgeFence{
 
 private:
   typedef priority_queue<FloodFillNode, vector<FloodFillNode>, greater<FloodFillNode> > pq;
 
   Mesh* mesh;
-  map<pair<int, int>, vector<Fence>> fences;
+  // Fences of edge e (Mesh edge id) are fences[fence_offset[e], fence_offset[e+1]),
+  // in the order they were passed; built in one pass after the floodfill.
+  vector<int> fence_offset;
+  vector<Fence> fences;
+  int active_edges;
+  // What get_fences reads: the two vectors above, or the arrays of a
+  // mapped fence index after load_fences until the next floodfill.
+  const int* offset_data;
+  const Fence* fence_data;
+  int fence_total;
+  shared_ptr<FenceIndexFile> mapped;
+  // Budgeted mode keeps at most fence_budget fences per edge, those with
+  // the lowest lb.  rest_lb[e] is a lower bound of g + |root, edge e| over
+  // the fences dropped from edge e, INF if none, rounded down to a float;
+  // empty without a budget.
+  int fence_budget;
+  vector<float> rest_lb;
+  // Depth d keeps a fence on an edge unless its own goal or d other goals
+  // have a fence there with an ub below its lb, so every edge keeps the d
+  // nearest goals of each point beyond it.  Roots are pruned by the same
+  // rule.  During a floodfill with d > 1, top_* hold the d+1 best ub of
+  // distinct goals of each edge and root_top_* the d+1 best g of distinct
+  // goals at each root, best first.
+  int fence_depth;
+  vector<double> top_val, root_top_val;
+  vector<int> top_gid, top_num, root_top_gid, root_top_num;
+  // During the floodfill: the fences passed so far with their edges, and
+  // the tightest ub of the first fence of each edge, INF while it has none.
+  vector<Fence> passed;
+  vector<int> passed_edge;
+  vector<double> first_ub;
+  // In a worker of a parallel floodfill: the tightest ub over the fences of
+  // all workers, so each one stops where another has fenced off already.
+  atomic<double>* shared_ub = nullptr;
+  // Nodes with a larger lb are left on the open list (bounded floodfill).
+  double flood_bound = INF;
+  // Hierarchy: polygons are grouped into clusters of about cluster_size
+  // adjacent polygons.  The coarse level keeps, for every cluster, its
+  // goals and the edges on its border (portals) with a lower bound of the
+  // distance from the portal to the nearest goal, from a Dijkstra over the
+  // portals, in that order.  The fine floodfill then only goes as far as
+  // fine_bound from the goals; fence_bound is the bound the current fences
+  // were built with, INF if they cover the whole mesh.
+  struct CoarseFence {
+    double d;
+    int edge;     // -1 for a goal in the cluster
+    int gid;
+  };
+  int cluster_size;
+  double fine_bound, fence_bound;
+  vector<int> poly_cluster;
+  vector<int> portal_offset, portals;
+  vector<int> coarse_offset;
+  vector<CoarseFence> coarse;
   pq open_list;
   vector<Point> goals;
+  vector<char> goal_alive;    // removed gids stay as holes
   warthog::timer timer;
 
   // root pruning
   vector<double> root_g_values;
   int search_id;
   vector<int> root_search_ids;
+  // Lazy mode builds no fences up front.  The edges are split into the
+  // cells of a grid by their midpoint; the fences of a region are built the
+  // first time a query asks for them, by a floodfill from the goals nearest
+  // to the region bounded by the distance of the nearest goal left out.
+  // At most lazy_capacity fences are cached, the least recently used
+  // regions go first.
+  struct LazyRegion {
+    vector<int> edges;
+    double minx, maxx, miny, maxy;  // box of its edges
+    bool seen;                      // goal distances below are known
+    bool warm, requested;
+    double cold_lb;                 // distance from the box to the nearest goal
+    int cold_gid;
+    double bound;                   // to the nearest goal left out, INF if none
+    vector<int> near_goals;
+    // fences of edges[i] are fences[offset[i], offset[i+1])
+    vector<int> offset;
+    vector<Fence> fences;
+    unsigned long long last_used;
+  };
+  bool lazy = false;
+  int lazy_near;
+  size_t lazy_capacity, lazy_cached;
+  unsigned long long lazy_clock;
+  vector<LazyRegion> regions;
+  vector<int> edge_region, edge_slot;
+  vector<int> requested;
   warthog::mem::cpool* node_pool;
   Successor* search_successors;
   SearchNode* search_nodes_to_push;
@@ -81,12 +178,46 @@ private:
     nodes_pushed = 0;
     nodes_popped = 0;
     nodes_pruned = 0;
+    nodes_intermediate = 0;
     fenceCnt = 0;
-    fences.clear();
-    gen_initial_nodes();
+    fences_dropped = 0;
+    flood_bound = fence_bound = fine_bound;
+    passed.clear();
+    passed_edge.clear();
+    first_ub.assign(mesh->edge_num, INF);
+    rest_lb.clear();
+    if (deep()) {
+      const int cap = fence_depth + 1;
+      const int numv = mesh->mesh_vertices.size();
+      top_val.resize(mesh->edge_num * cap);
+      top_gid.resize(mesh->edge_num * cap);
+      top_num.assign(mesh->edge_num, 0);
+      root_top_val.resize(numv * cap);
+      root_top_gid.resize(numv * cap);
+      root_top_num.resize(numv);
+    }
+    gen_initial_nodes(0, goals.size());
+  }
+
+  bool deep() const {
+    return fence_depth > 1 && !lazy;
   }
+  bool pass_root(int root, double g, int gid);
+  bool root_beaten(int root, double g, int gid) const;
+  void expand();
+  void unpack_fences(int skip_gid);
+  void repair(const vector<int>& gids, bool fresh_roots);
+  void build_fences(bool by_lb);
+  void use_built();
+  void cap_fences();
+  void build_coarse();
+  void sort_by_key(vector<int>& offset, vector<Fence>& fs) const;
+  void reset_lazy();
+  void see_region(LazyRegion& reg);
+  void build_regions(const vector<int>& rs);
+  Fence make_fence(const FloodFillNode& fnode) const;
 
-  void gen_initial_nodes();
+  void gen_initial_nodes(int from, int to);
   bool pass_fence(const FloodFillNode& fnode);
   int succ_to_node(
     SearchNodePtr parent, Successor* successors, int num_succ, SearchNodePtr nodes, int gid
@@ -97,13 +228,31 @@ public:
   int nodes_pushed;
   int nodes_popped;
   int nodes_pruned;
-  int fenceCnt;
+  int nodes_intermediate;     // Corridor intervals followed without pushing
+  int fenceCnt;               // Fences kept after the floodfill
+  int fences_dropped;         // Fences passed but dominated on their edge
+  int fences_capped;          // Fences over the budget of their edge
+  int capped_edges;           // Edges with fences over the budget
+  int lazy_built;             // Regions built in lazy mode
+  int lazy_evicted;           // Regions dropped from the cache
   int edgecnt;
   bool verbose;
   KnnMeshEdgeFence(Mesh* m): mesh(m) {
     int nump = m->mesh_polygons.size();
+    fence_offset.assign(m->edge_num + 1, 0);
     fences.clear();
+    use_built();
+    active_edges = 0;
     fenceCnt = 0;
+    fences_dropped = 0;
+    fences_capped = 0;
+    capped_edges = 0;
+    fence_budget = 0;
+    fence_depth = 1;
+    cluster_size = 0;
+    fine_bound = fence_bound = INF;
+    lazy_built = 0;
+    lazy_evicted = 0;
     edgecnt = 0;
     for (int i=0; i<nump; i++) {
       int numv = m->mesh_polygons[i].vertices.size();
@@ -116,6 +265,15 @@ public:
     init();
   }
 
+  KnnMeshEdgeFence(const KnnMeshEdgeFence&) = delete;
+  void operator=(const KnnMeshEdgeFence&) = delete;
+
+  ~KnnMeshEdgeFence() {
+    delete node_pool;
+    delete[] search_successors;
+    delete[] search_nodes_to_push;
+  }
+
   void print_node(const FloodFillNode& fnode, ostream& outfile);
 
   void init() {
@@ -137,24 +295,153 @@ public:
 
   void set_goals(vector<Point> gs) {
     goals = vector<Point>(gs);
+    goal_alive.assign(goals.size(), 1);
+    if (lazy) reset_lazy();
   }
 
   void floodfill();
+  // Splits the goals over threads, each running its own floodfill with its
+  // own open list and node pool, and merges their fences edge by edge.
+  void floodfill(int threads);
+
+  // Update the fences of the last floodfill for one target.  A new goal
+  // gets the next gid and floods until existing fences are nearer; a
+  // removed goal loses its fences and the goals around them flood again.
+  // Gids of the other goals do not change.
+  int add_goal(const Point& p);
+  void remove_goal(int gid);
 
   double get_processing_micro() {
     return timer.elapsed_time_micro();
   }
 
-  const vector<Fence>& get_fences(int left_vid, int right_vid) {
-    pair<int, int> key = {min(left_vid, right_vid), max(left_vid, right_vid)};
-    return fences[key];
+  // Fences of the edge between vertices left_vid and right_vid of polygon poly.
+  int get_edge(int poly, int left_vid, int right_vid) const {
+    return mesh->get_edge(poly, left_vid, right_vid);
   }
 
-  int get_active_edge_cnt() {
-    return fences.size();
+  FenceRange get_fences(int edge) const {
+    return {fence_data + offset_data[edge], fence_data + offset_data[edge+1]};
+  }
+
+  // fences of all edges, edge by edge
+  FenceRange get_all_fences() const {
+    return {fence_data, fence_data + fence_total};
+  }
+
+  int get_fence_num(int edge) const {
+    return offset_data[edge+1] - offset_data[edge];
+  }
+
+  int get_edge_num() const {
+    return mesh->edge_num;
+  }
+
+  // End points of the interval of a fence on the edge between vertices a and b.
+  void get_interval(const Fence& f, int a, int b, Point& left, Point& right) const {
+    const Point& p = mesh->mesh_vertices[min(a, b)].p;
+    const Point d = mesh->mesh_vertices[max(a, b)].p - p;
+    left = p + d * (double)f.left;
+    right = p + d * (double)f.right;
+  }
+
+  // At most per_edge fences are kept on an edge by the next floodfill, 0
+  // keeps all.  Beyond that, FenceHeuristic falls back to get_rest_lb.
+  void set_fence_budget(int per_edge) {
+    fence_budget = per_edge;
+  }
+
+  int get_fence_budget() const {
+    return fence_budget;
   }
-  const map<pair<int, int>, vector<Fence>> get_all_fences() {
-    return this->fences;
+
+  // Fences of the d nearest goals are kept on every edge by the next
+  // floodfill, which then runs on one thread; updates flood again from
+  // scratch.  Lazy mode keeps depth 1.
+  void set_fence_depth(int d) {
+    fence_depth = max(1, d);
+  }
+
+  int get_fence_depth() const {
+    return lazy? 1: fence_depth;
+  }
+
+  // Lower bound of the distance from edge to the goals of its dropped
+  // fences, or to any goal without a fence there past fence_bound.
+  double get_rest_lb(int edge) const {
+    return rest_lb.empty() || std::isinf(rest_lb[edge])? fence_bound: min(fence_bound, (double)rest_lb[edge]);
+  }
+
+  // Some goal not removed, -1 if there is none: the gid of a node whose
+  // edge only has the bound of get_rest_lb.
+  int get_live_goal() const {
+    for (int i=0; i<(int)goal_alive.size(); i++)
+      if (goal_alive[i]) return i;
+    return -1;
+  }
+
+  // Two levels from the next floodfill on: a coarse level over clusters of
+  // about cluster_size polygons, and fences only up to fine_bound from the
+  // goals.  Cluster size 0 switches back to fences everywhere.
+  void set_hierarchy(int cluster_size, double fine_bound);
+
+  bool has_coarse() const {
+    return !coarse_offset.empty();
+  }
+
+  // Lower bound of the distance from root to the nearest goal through an
+  // interval entering poly, base = |root, interval|; gid is that goal,
+  // -1 (and INF) if none can be reached.
+  double get_coarse_bound(int poly, const Point& root, double base, int& gid) const;
+
+  int get_cluster_num() const {
+    return portal_offset.empty()? 0: portal_offset.size() - 1;
+  }
+
+  // bytes held by the fence index
+  size_t get_fence_bytes() const {
+    return fence_total * sizeof(Fence) + (mesh->edge_num + 1) * sizeof(int)
+      + first_ub.capacity() * sizeof(double) + rest_lb.capacity() * sizeof(float)
+      + coarse.capacity() * sizeof(CoarseFence) + (coarse_offset.capacity()
+      + poly_cluster.capacity() + portal_offset.capacity() + portals.capacity()) * sizeof(int);
+  }
+
+  const vector<Point>& get_goals() const {
+    return goals;
+  }
+
+  // Write the fences and goals of the last floodfill as a fence index file.
+  bool save_fences(const string& path) const;
+  // Map a fence index built for this mesh and, unless goals_hash is 0, for
+  // the goal set with that hash (hash_goals); the fences are read from the
+  // mapping, the goals are copied.  Updates work as after a floodfill.
+  bool load_fences(const string& path, unsigned long long goals_hash = 0);
+
+  // Switch to lazy mode with a grid x grid grid of regions, keeping at most
+  // capacity fences and building each region from its near_goals nearest
+  // goals; grid 0 switches back, leaving fences to the next floodfill.
+  void set_lazy(int grid, size_t capacity, int near_goals = 16);
+
+  bool is_lazy() const {
+    return lazy;
+  }
+
+  // Lazy mode: the fences of edge, empty while its region is cold, and a
+  // lower bound rest of the distance from the edge to the goals without a
+  // fence there, with the nearest goal as rest_gid.  A cold region is built
+  // by the next warm_up.
+  FenceRange get_lazy_fences(int edge, double& rest, int& rest_gid);
+  // Build the regions asked for since the last call and evict down to the
+  // capacity.
+  void warm_up();
+
+  size_t get_lazy_fence_num() const {
+    return lazy_cached;
+  }
+
+  // edges with at least one fence
+  int get_active_edge_cnt() {
+    return active_edges;
   }
 };
 
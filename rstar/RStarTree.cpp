@@ -347,6 +347,80 @@ void RStarTree::print()
     root->print("");
 }
 
+/** Group items into nodes of at most maxChild, following Sort-Tile-Recursive.
+  *
+  * Sort the items by the x-center of their rectangles and cut them into ceil(sqrt(P)) vertical slices,
+  * P = ceil(n / maxChild) being the number of nodes needed.
+  * Sort each slice by the y-center and pack maxChild consecutive items per node.
+  */
+template<typename T, typename GetMbr>
+static void strPack(vector<T> &items, GetMbr getMbr, vector<vector<T> > &groups)
+{
+    const size_t cap = RStarTree::maxChild;
+    const size_t n = items.size();
+    const size_t pages = (n + cap - 1) / cap;
+    const size_t slices = (size_t)ceil(sqrt((double)pages));
+    const size_t sliceSize = slices * cap;
+    auto byCenter = [&](size_t dim) {
+        return [&, dim](const T &a, const T &b) {
+            const Mbr &ma = getMbr(a), &mb = getMbr(b);
+            return ma.coord[dim][0] + ma.coord[dim][1] < mb.coord[dim][0] + mb.coord[dim][1];
+        };
+    };
+    sort(items.begin(), items.end(), byCenter(0));
+    for(size_t from = 0; from < n; from += sliceSize)
+    {
+        const size_t to = min(n, from + sliceSize);
+        sort(items.begin() + from, items.begin() + to, byCenter(1));
+        for(size_t i = from; i < to; i += cap)
+            groups.push_back(vector<T>(items.begin() + i, items.begin() + min(to, i + cap)));
+    }
+}
+
+/** Build the tree bottom-up from all entries at once.
+  *
+  * Leaves are packed from the entries with strPack, then every upper level is packed from the level below,
+  * until a single root remains. Nodes are full except the last one of each slice.
+  */
+void RStarTree::bulkLoad(const Entry_P_V &entryPtrs)
+{
+    delete root;
+    root = new RTreeNode(LEAF_LEVEL);
+    if(entryPtrs.empty())
+        return;
+
+    Entry_P_V entries(entryPtrs);
+    vector<Entry_P_V> leafGroups;
+    strPack(entries, [](const Entry_P &e) -> const Mbr& { return e->mbre; }, leafGroups);
+
+    Node_P_V nodes;
+    for(Entry_P_V &group : leafGroups)
+    {
+        Node_P leaf = new RTreeNode(LEAF_LEVEL);
+        for(Entry_P entryPtr : group)
+            leaf->insert(entryPtr);
+        nodes.push_back(leaf);
+    }
+
+    size_t level = LEAF_LEVEL;
+    while(nodes.size() > 1)
+    {
+        level++;
+        vector<Node_P_V> groups;
+        strPack(nodes, [](const Node_P &n) -> const Mbr& { return n->mbrn; }, groups);
+        nodes.clear();
+        for(Node_P_V &group : groups)
+        {
+            Node_P node = new RTreeNode(level);
+            for(Node_P childPtr : group)
+                node->insert(childPtr);
+            nodes.push_back(node);
+        }
+    }
+    delete root;
+    root = nodes[0];
+}
+
 /** Invoke Insert starting with the leaf level as a parameter, to insert a new data rectangle.
   */
 void RStarTree::insertData(Entry_P entryPtr)
@@ -396,6 +470,126 @@ void RStarTree::insert(Node_P childPtr, Entry_P entryPtr, size_t desiredLevel, s
     }
 }
 
+/** Invoke FindLeaf to locate the leaf node L containing E. Stop if the record was not found.
+  *
+  * Remove E from L.
+  * Invoke CondenseTree, passing L.
+  * If the root node has only one child after the tree has been adjusted, make the child the new root.
+  */
+bool RStarTree::deleteData(Entry_P entryPtr)
+{
+    Node_P leaf = findLeaf(root, entryPtr);
+    if(!leaf)
+        return false;
+
+    Entry_P_V &entries = *leaf->entries;
+    entries.erase(find(entries.begin(), entries.end(), entryPtr));
+    leaf->decreaseAggregate(1);
+    leaf->adjustMbr();
+    condenseTree(leaf);
+
+    while(root->level && root->size() == 1)
+    {
+        Node_P child = root->children->at(0);
+        root->children->clear();
+        delete root;
+        root = child;
+        root->parent = NULL;
+    }
+    return true;
+}
+
+/** If N is a leaf, check each entry to see if it is E.
+  * Otherwise, invoke FindLeaf on every child whose rectangle contains the rectangle of E.
+  */
+Node_P RStarTree::findLeaf(Node_P node, Entry_P entryPtr)
+{
+    if(!node->level)
+        return find(node->entries->begin(), node->entries->end(), entryPtr) != node->entries->end() ? node : NULL;
+
+    const Mbr &mbr = entryPtr->mbre;
+    for(Node_P childPtr : *node->children)
+    {
+        const Mbr &box = childPtr->mbrn;
+        bool contains = true;
+        for(size_t dim = 0; dim < DIM; dim++)
+            if(box.coord[dim][0] > mbr.coord[dim][0] || box.coord[dim][1] < mbr.coord[dim][1])
+                contains = false;
+        if(!contains)
+            continue;
+        Node_P leaf = findLeaf(childPtr, entryPtr);
+        if(leaf)
+            return leaf;
+    }
+    return NULL;
+}
+
+/** Walking up from the leaf L, remove every node N with less than m entries from its parent
+  * and keep its entries (or subtrees) aside; the covering rectangles on the path were adjusted by the removal.
+  *
+  * Reinsert the orphaned entries at the leaf level and the orphaned subtrees at their own level.
+  * A subtree that can no longer be placed at its level (the tree became too low) is reinserted entry by entry.
+  */
+void RStarTree::condenseTree(Node_P leaf)
+{
+    Entry_P_V orphanEntries;
+    Node_P_V orphanNodes;
+
+    Node_P node = leaf;
+    while(node->parent)
+    {
+        Node_P parent = node->parent;
+        if(node->size() < RStarTree::minChild)
+        {
+            Node_P_V &siblings = *parent->children;
+            siblings.erase(find(siblings.begin(), siblings.end(), node));
+            parent->decreaseAggregate(node->aggregate);
+            parent->adjustMbr();
+            if(node->level)
+            {
+                for(Node_P childPtr : *node->children)
+                    orphanNodes.push_back(childPtr);
+                node->children->clear();
+            }
+            else
+                orphanEntries.insert(orphanEntries.end(), node->entries->begin(), node->entries->end());
+            delete node;
+        }
+        node = parent;
+    }
+
+    if(root->level && root->size() == 0)
+    {
+        delete root;
+        root = new RTreeNode(LEAF_LEVEL);
+    }
+
+    for(size_t io = 0; io < orphanNodes.size(); io++)
+    {
+        Node_P childPtr = orphanNodes[io];
+        if(childPtr->level < root->level)
+        {
+            size_t overflowLevel = -1;
+            overflowLevel <<= (root->level);
+            insert(childPtr, NULL, childPtr->level + 1, overflowLevel);
+        }
+        else if(childPtr->level)
+        {
+            for(Node_P grandChild : *childPtr->children)
+                orphanNodes.push_back(grandChild);
+            childPtr->children->clear();
+            delete childPtr;
+        }
+        else
+        {
+            orphanEntries.insert(orphanEntries.end(), childPtr->entries->begin(), childPtr->entries->end());
+            delete childPtr;
+        }
+    }
+    for(Entry_P entryPtr : orphanEntries)
+        insertData(entryPtr);
+}
+
 /** Set N to be the root.
   *
   * If N is a leaf, return N.
@@ -131,6 +131,12 @@ typedef struct RStarTree
     /// Insertion
     void insertData(Entry_P entryPtr);
 
+    /// Bulk loading - Sort-Tile-Recursive, replaces the content of the tree
+    void bulkLoad(const Entry_P_V &entryPtrs);
+
+    /// Deletion, false if the entry is not in the tree
+    bool deleteData(Entry_P entryPtr);
+
     private:
         /// Insertion
         void insert(Node_P childPtr, Entry_P entryPtr, size_t desiredLevel, size_t &overflowLevel); // with OverflowTreatment
@@ -138,6 +144,10 @@ typedef struct RStarTree
         /// Insertion - ChooseSubtree
         Node_P chooseSubtree(Mbr &mbr, size_t desiredLevel);
 
+        /// Deletion - FindLeaf, CondenseTree
+        Node_P findLeaf(Node_P node, Entry_P entryPtr);
+        void condenseTree(Node_P leaf);
+
         /// Insertion - OverflowTreatment - ReInsert
         void reInsert(RTreeNode &node, size_t &overflowLevel);
 
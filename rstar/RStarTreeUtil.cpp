@@ -200,6 +200,7 @@ void RStarTreeUtil::rangeQuery(RStarTree* tree, Point q, double minr, double max
 }
 
 MinHeapEntry RStarTreeUtil::iNearestNeighbour(MinHeap& heap, Point q) {
+  // keys of the pushed entries are squared distances, only the result is square rooted
   MinHeapEntry res(INF, (Entry_P)nullptr);
   while (!heap.isEmpty()) {
     MinHeapEntry e = heap.pop();
@@ -208,19 +209,20 @@ MinHeapEntry RStarTreeUtil::iNearestNeighbour(MinHeap& heap, Point q) {
       if (nodePtr->level) {
         Node_P_V& children = *nodePtr->children;
         for (const auto& it: children) {
-          double d = sqrt(minDis2(q, it->mbrn));
-          heap.push(MinHeapEntry(d, it));
+          double d2 = minDis2(q, it->mbrn);
+          heap.push(MinHeapEntry(d2, it));
         }
       }
       else {
         Entry_P_V& entries = *nodePtr->entries;
         for (const auto& it: entries) {
-          double d = sqrt(minDis2(q, it->mbre));
-          heap.push(MinHeapEntry(d, it));
+          double d2 = minDis2(q, it->mbre);
+          heap.push(MinHeapEntry(d2, it));
         }
       }
     } else {
       res = e;
+      res.key = sqrt(e.key);
       break;
     }
   }
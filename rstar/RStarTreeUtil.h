@@ -126,7 +126,7 @@ class RStarTreeUtil
 
         // range query in ring(minr, maxr, q)
         static void rangeQuery(RStarTree* tree, Point q, double minr, double maxr, std::vector<Data_P>& outIter);
-        // incremental nearest neighbor retrieval
+        // incremental nearest neighbor retrieval, heap keys are squared distances, the result key is the distance
         static MinHeapEntry iNearestNeighbour(MinHeap& heap, Point q);
         static bool find(RStarTree& tree, Coord point[DIM]);
         static bool isEnclosed(Point& point, Node_P node); // test if point is inclusive enclosed by node
@@ -0,0 +1,278 @@
+#include "StaticRTree.h"
+#include "RStarTreeUtil.h"
+#include "consts.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RSTAR_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace rstar {
+
+using namespace std;
+
+/*******************************************************************************
+ * Distance kernels - one query point against n boxes stored column-wise
+ ******************************************************************************/
+
+typedef void (*Dis2Fn)(double x, double y, const Coord *x0, const Coord *x1, const Coord *y0, const Coord *y1,
+                       int n, double *out);
+
+static void minDis2Scalar(double x, double y, const Coord *x0, const Coord *x1, const Coord *y0, const Coord *y1,
+                          int n, double *out)
+{
+    for(int i = 0; i < n; i++)
+    {
+        const double dx = max(max(x0[i] - x, x - x1[i]), 0.0);
+        const double dy = max(max(y0[i] - y, y - y1[i]), 0.0);
+        out[i] = dx * dx + dy * dy;
+    }
+}
+
+static void maxDis2Scalar(double x, double y, const Coord *x0, const Coord *x1, const Coord *y0, const Coord *y1,
+                          int n, double *out)
+{
+    for(int i = 0; i < n; i++)
+    {
+        const double dx = max(fabs(x0[i] - x), fabs(x1[i] - x));
+        const double dy = max(fabs(y0[i] - y), fabs(y1[i] - y));
+        out[i] = dx * dx + dy * dy;
+    }
+}
+
+#ifdef RSTAR_X86_KERNELS
+/// Same operation order as the scalar kernels, so results agree bit-for-bit.
+__attribute__((target("avx")))
+static void minDis2Avx(double x, double y, const Coord *x0, const Coord *x1, const Coord *y0, const Coord *y1,
+                       int n, double *out)
+{
+    const __m256d qx = _mm256_set1_pd(x), qy = _mm256_set1_pd(y);
+    const __m256d zero = _mm256_setzero_pd();
+    int i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        const __m256d dx = _mm256_max_pd(_mm256_max_pd(_mm256_sub_pd(_mm256_loadu_pd(x0 + i), qx),
+                                                       _mm256_sub_pd(qx, _mm256_loadu_pd(x1 + i))), zero);
+        const __m256d dy = _mm256_max_pd(_mm256_max_pd(_mm256_sub_pd(_mm256_loadu_pd(y0 + i), qy),
+                                                       _mm256_sub_pd(qy, _mm256_loadu_pd(y1 + i))), zero);
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+    }
+    minDis2Scalar(x, y, x0 + i, x1 + i, y0 + i, y1 + i, n - i, out + i);
+}
+
+__attribute__((target("avx")))
+static void maxDis2Avx(double x, double y, const Coord *x0, const Coord *x1, const Coord *y0, const Coord *y1,
+                       int n, double *out)
+{
+    const __m256d qx = _mm256_set1_pd(x), qy = _mm256_set1_pd(y);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    int i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        const __m256d dx = _mm256_max_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(_mm256_loadu_pd(x0 + i), qx)),
+                                         _mm256_andnot_pd(sign, _mm256_sub_pd(_mm256_loadu_pd(x1 + i), qx)));
+        const __m256d dy = _mm256_max_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(_mm256_loadu_pd(y0 + i), qy)),
+                                         _mm256_andnot_pd(sign, _mm256_sub_pd(_mm256_loadu_pd(y1 + i), qy)));
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+    }
+    maxDis2Scalar(x, y, x0 + i, x1 + i, y0 + i, y1 + i, n - i, out + i);
+}
+
+static bool hasAvx()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+}
+
+static Dis2Fn minDis2Fn = hasAvx() ? minDis2Avx : minDis2Scalar;
+static Dis2Fn maxDis2Fn = hasAvx() ? maxDis2Avx : maxDis2Scalar;
+#else
+static Dis2Fn minDis2Fn = minDis2Scalar;
+static Dis2Fn maxDis2Fn = maxDis2Scalar;
+#endif
+
+bool StaticRTree::useSimd(bool on)
+{
+    #ifdef RSTAR_X86_KERNELS
+    if(on && hasAvx())
+    {
+        minDis2Fn = minDis2Avx;
+        maxDis2Fn = maxDis2Avx;
+        return true;
+    }
+    #endif
+    minDis2Fn = minDis2Scalar;
+    maxDis2Fn = maxDis2Scalar;
+    return false;
+}
+
+void StaticRTree::minDis2(const Point &q, const StaticNode &node, double *out) const
+{
+    const int i = node.first;
+    minDis2Fn(q.coord[0], q.coord[1], &xmin[i], &xmax[i], &ymin[i], &ymax[i], node.size, out);
+}
+
+void StaticRTree::maxDis2(const Point &q, const StaticNode &node, double *out) const
+{
+    const int i = node.first;
+    maxDis2Fn(q.coord[0], q.coord[1], &xmin[i], &xmax[i], &ymin[i], &ymax[i], node.size, out);
+}
+
+/** Copy the tree level by level.
+  *
+  * Nodes are numbered in breadth first order, so the children of a node get consecutive indices
+  * and the slots of consecutive nodes are consecutive as well.
+  */
+void StaticRTree::build(const RStarTree &tree)
+{
+    nodes.clear();
+    xmin.clear(); xmax.clear(); ymin.clear(); ymax.clear();
+    child.clear();
+    up.clear();
+    payloadSlot.clear();
+    mask.clear();
+    mbr = tree.root->mbrn;
+    maxSize = 0;
+    payloads = 0;
+
+    Node_P_V queue(1, tree.root);
+    vector<int> parentSlot(1, -1);
+    for(size_t i = 0; i < queue.size(); i++)
+    {
+        Node_P nodePtr = queue[i];
+        StaticNode node;
+        node.level = (int)nodePtr->level;
+        node.first = (int)child.size();
+        node.size = (int)nodePtr->size();
+        nodes.push_back(node);
+        maxSize = max(maxSize, node.size);
+
+        auto addSlot = [&](const Mbr &box, int value) {
+            xmin.push_back(box.coord[0][0]);
+            xmax.push_back(box.coord[0][1]);
+            ymin.push_back(box.coord[1][0]);
+            ymax.push_back(box.coord[1][1]);
+            child.push_back(value);
+            up.push_back(parentSlot[i]);
+        };
+        if(nodePtr->level)
+        {
+            for(Node_P childPtr : *nodePtr->children)
+            {
+                parentSlot.push_back((int)child.size());
+                addSlot(childPtr->mbrn, (int)queue.size());
+                queue.push_back(childPtr);
+            }
+        }
+        else
+        {
+            for(Entry_P entryPtr : *nodePtr->entries)
+            {
+                const int payload = *((int*)entryPtr->data);
+                if(payload >= (int)payloadSlot.size())
+                    payloadSlot.resize(payload + 1, -1);
+                payloadSlot[payload] = (int)child.size();
+                addSlot(entryPtr->mbre, payload);
+                payloads++;
+            }
+        }
+    }
+
+    // children come after their parents, so one backward pass sums the counts up
+    aggregate.assign(child.size(), 0);
+    for(int n = (int)nodes.size() - 1; n >= 0; n--)
+    {
+        const StaticNode &node = nodes[n];
+        for(int slot = node.first; slot < node.first + node.size; slot++)
+        {
+            if(!node.level)
+                aggregate[slot] = 1;
+            if(up[slot] != -1)
+                aggregate[up[slot]] += aggregate[slot];
+        }
+    }
+}
+
+bool StaticRTree::remove(int payload)
+{
+    if(payload < 0 || payload >= (int)payloadSlot.size() || payloadSlot[payload] == -1)
+        return false;
+    for(int slot = payloadSlot[payload]; slot != -1; slot = up[slot])
+        aggregate[slot]--;
+    payloadSlot[payload] = -1;
+    payloads--;
+    return true;
+}
+
+void StaticRTree::setMasks(const vector<unsigned> &attrs)
+{
+    mask.assign(child.size(), 0);
+    for(int n = (int)nodes.size() - 1; n >= 0; n--)
+    {
+        const StaticNode &node = nodes[n];
+        for(int slot = node.first; slot < node.first + node.size; slot++)
+        {
+            if(!node.level)
+                mask[slot] = attrs[child[slot]];
+            if(up[slot] != -1)
+                mask[up[slot]] |= mask[slot];
+        }
+    }
+}
+
+void StaticRTree::setMask(int payload, unsigned bits)
+{
+    if(mask.empty() || payload >= (int)payloadSlot.size() || payloadSlot[payload] == -1)
+        return;
+    const int slot = payloadSlot[payload];
+    mask[slot] = bits;
+    for(int s = up[slot]; s != -1; s = up[s])
+    {
+        const StaticNode &node = nodes[child[s]];
+        unsigned bitsBelow = 0;
+        for(int i = node.first; i < node.first + node.size; i++)
+            bitsBelow |= mask[i];
+        mask[s] = bitsBelow;
+    }
+}
+
+void StaticRTree::start(StaticMinHeap &heap, const Point &q) const
+{
+    if(isEmpty())
+        return;
+    heap.push(StaticHeapEntry(RStarTreeUtil::minDis2(q, mbr), 0, -1));
+}
+
+StaticHeapEntry StaticRTree::iNearestNeighbour(StaticMinHeap &heap, const Point &q,
+                                               const StaticCountOverlay *live, unsigned filter) const
+{
+    StaticHeapEntry res(INF, -1, -1);
+    while(!heap.isEmpty())
+    {
+        StaticHeapEntry e = heap.pop();
+        if(e.node == -1)
+        {
+            res = e;
+            res.key = sqrt(e.key);
+            break;
+        }
+        const StaticNode &node = nodes[e.node];
+        heap.dis.resize(maxSize);
+        minDis2(q, node, heap.dis.data());
+        for(int i = 0; i < node.size; i++)
+        {
+            const int slot = node.first + i;
+            if(live ? !live->get(slot) : !aggregate[slot])
+                continue;
+            if(filter && !matches(slot, filter))
+                continue;
+            if(node.level)
+                heap.push(StaticHeapEntry(heap.dis[i], child[slot], -1));
+            else
+                heap.push(StaticHeapEntry(heap.dis[i], -1, child[slot]));
+        }
+    }
+    return res;
+}
+
+} // namespace rstar
@@ -0,0 +1,171 @@
+#pragma once
+#include "RStarTree.h"
+#include "Data.h"
+
+namespace rstar {
+
+/*******************************************************************************
+ * StaticHeapEntry - either a node to expand or a payload
+ ******************************************************************************/
+typedef struct StaticHeapEntry
+{
+    StaticHeapEntry(double key, int node, int id)
+        : key(key), node(node), id(id)
+        { }
+
+    double key;
+    int node; // node index, -1 for a payload
+    int id;   // payload, for a node -1 or a tag of the caller
+
+    bool operator< (const StaticHeapEntry& e) const;
+}StaticHeapEntry;
+
+inline bool StaticHeapEntry::operator< (const StaticHeapEntry& e) const
+{
+    return key > e.key;
+}
+
+/*******************************************************************************
+ * StaticMinHeap
+ ******************************************************************************/
+typedef struct StaticMinHeap
+{
+    vector<StaticHeapEntry> hv;
+    vector<double> dis; // scratch for the distances of one node's children
+
+    void push(StaticHeapEntry e);
+    StaticHeapEntry pop();
+    bool isEmpty() { return hv.empty(); }
+    void clear() { hv.clear(); }
+}StaticMinHeap;
+
+inline void StaticMinHeap::push(StaticHeapEntry e)
+{
+    hv.push_back(e);
+    push_heap(hv.begin(), hv.end());
+}
+
+inline StaticHeapEntry StaticMinHeap::pop()
+{
+    StaticHeapEntry e = hv.front();
+    pop_heap(hv.begin(), hv.end());
+    hv.pop_back();
+    return e;
+}
+
+/*******************************************************************************
+ * StaticRTree - read-only copy of an RStarTree packed into flat arrays
+ *
+ * Nodes are stored breadth first in one vector, the root is node 0.
+ * The children of a node occupy the slots [first, first + size), and the
+ * boxes of all slots are kept column-wise (xmin, xmax, ymin, ymax), so one
+ * node's child boxes are contiguous in memory.  A slot of an inner node holds
+ * the index of the child node, a slot of a leaf holds the int payload itself.
+ ******************************************************************************/
+struct StaticCountOverlay;
+
+typedef struct StaticNode
+{
+    int level; // All leaf nodes are at level 0.
+    int first;
+    int size;
+}StaticNode;
+
+typedef struct StaticRTree
+{
+    vector<StaticNode> nodes;
+    vector<Coord> xmin, xmax, ymin, ymax;
+    vector<int> child;
+    vector<int> aggregate; // number of payloads below each slot
+    vector<int> up; // the slot pointing to the node of each slot, -1 in the root
+    vector<int> payloadSlot; // leaf slot of each payload, -1 if absent
+    vector<unsigned> mask; // OR of the attribute bits of the payloads below each slot, empty without attributes
+    Mbr mbr; // box of the root
+    int maxSize = 0; // largest node
+    int payloads = 0;
+
+    /// Copy the tree, payloads are read as *(int*)entry->data
+    void build(const RStarTree &tree);
+    /// Drop a payload without repacking: its slot stays but counts for nothing,
+    /// so searches skip it.  Returns false if the payload is not in the tree.
+    bool remove(int payload);
+    /// Attribute bits of every payload, attrs[payload], OR-aggregated up the tree
+    void setMasks(const vector<unsigned> &attrs);
+    /// Change the bits of one payload, the masks on its path are recomputed
+    void setMask(int payload, unsigned bits);
+    /// Some payload below the slot may have all bits of the filter
+    bool matches(int slot, unsigned filter) const { return (mask[slot] & filter) == filter; }
+
+    bool isEmpty() const { return nodes.empty() || nodes[0].size == 0; }
+    Mbr slotMbr(int slot) const { return Mbr(xmin[slot], xmax[slot], ymin[slot], ymax[slot]); }
+    double minDis2(const Point &q, int slot) const; // min distance from point to the box of a slot
+
+    /// Squared min / max distance from q to the boxes of all children of a node, out must hold node.size values
+    void minDis2(const Point &q, const StaticNode &node, double *out) const;
+    void maxDis2(const Point &q, const StaticNode &node, double *out) const;
+    /// Switch between the vector and the scalar distance kernels, returns whether the vector ones are used
+    static bool useSimd(bool on);
+
+    /// Push the root into an empty heap, to start an incremental search from q.
+    /// Heap keys are squared distances.
+    void start(StaticMinHeap &heap, const Point &q) const;
+    /// incremental nearest neighbor retrieval, the key of the result is the distance, INF when no payload is left.
+    /// Slots without payloads left are skipped, live ones only with an overlay.
+    /// With a filter, only payloads having all of its bits are returned.
+    StaticHeapEntry iNearestNeighbour(StaticMinHeap &heap, const Point &q,
+                                      const StaticCountOverlay *live = NULL, unsigned filter = 0) const;
+}StaticRTree;
+
+/*******************************************************************************
+ * StaticCountOverlay - payloads left below each slot during one query
+ *
+ * Starts from the aggregates of the tree and is decremented along the path of
+ * every removed payload, so a search can skip a subtree as soon as nothing is
+ * left in it.  Counts are stamped with the query id, so reset is O(1).
+ ******************************************************************************/
+typedef struct StaticCountOverlay
+{
+    const StaticRTree *tree = NULL;
+    vector<int> count, stamp;
+    int id = 0;
+    int remaining = 0; // payloads left in the whole tree
+
+    void reset(const StaticRTree &t);
+    int get(int slot) const { return stamp[slot] == id ? count[slot] : tree->aggregate[slot]; }
+    void remove(int payload);
+}StaticCountOverlay;
+
+inline void StaticCountOverlay::reset(const StaticRTree &t)
+{
+    if(tree != &t || stamp.size() != t.child.size())
+    {
+        tree = &t;
+        count.assign(t.child.size(), 0);
+        stamp.assign(t.child.size(), 0);
+        id = 0;
+    }
+    id++;
+    remaining = t.payloads;
+}
+
+inline void StaticCountOverlay::remove(int payload)
+{
+    if(payload >= (int)tree->payloadSlot.size() || tree->payloadSlot[payload] == -1)
+        return;
+    for(int slot = tree->payloadSlot[payload]; slot != -1; slot = tree->up[slot])
+    {
+        count[slot] = get(slot) - 1;
+        stamp[slot] = id;
+    }
+    remaining--;
+}
+
+inline double StaticRTree::minDis2(const Point &q, int slot) const
+{
+    const double x = q.coord[0], y = q.coord[1];
+    const double dx = max(max(xmin[slot] - x, x - xmax[slot]), 0.0);
+    const double dy = max(max(ymin[slot] - y, y - ymax[slot]), 0.0);
+    return dx * dx + dy * dy;
+}
+
+}
@@ -5,6 +5,7 @@
 #include "consts.h"
 #include "RStarTree.h"
 #include "RStarTreeUtil.h"
+#include "expansion.h"
 #include <queue>
 #include <vector>
 #include <cassert>
@@ -22,19 +23,17 @@ namespace polyanya {
     priority_queue<double, vector<double>> maxh;
     vector<pair<double, Point>> edists;
     vector<double> odists;
-    rs::MinHeap heap;
+    rs::StaticMinHeap heap;
     rs::Point P(start.x, start.y);
-    double D = sqrt(rs::RStarTreeUtil::minDis2(P, rte->root->mbrn));
-    heap.push(rs::MinHeapEntry(D, rte->root));
-    rs::MinHeapEntry cur(INF, (rs::Entry_P)nullptr);
+    srt.start(heap, P);
     while (true) {
       auto stime = std::chrono::steady_clock::now();
-      cur = rs::RStarTreeUtil::iNearestNeighbour(heap, P);
+      rs::StaticHeapEntry cur = srt.iNearestNeighbour(heap, P);
       auto etime = std::chrono::steady_clock::now();
       rtree_cost += std::chrono::duration_cast<std::chrono::microseconds>(etime- stime).count();
       if (cur.key == INF) // not found
         break;
-      int gid = *((int*)cur.entryPtr->data);
+      int gid = cur.id;
       double de = goals[gid].distance(start);
       if ((int)maxh.size() == K && maxh.top() <= de)
         break;
@@ -59,4 +58,30 @@ namespace polyanya {
     sort(odists.begin(), odists.end());
     return odists;
   }
+
+  bool IERPolyanya::save_targets(const std::string& path) {
+    MeshPtr mesh = polyanya->get_mesh();
+    TargetIndex index;
+    index.goals = goals;
+    for (Point& g: goals)
+      index.goal_poly.push_back(get_point_location_in_search(g, mesh, verbose).poly1);
+    index.attrs.assign(goals.size(), 0);
+    index.alive.assign(goals.size(), 1);
+    index.tree = srt;
+    return save_target_index(path, mesh->get_hash(), index);
+  }
+
+  bool IERPolyanya::load_targets(const std::string& path) {
+    TargetIndex index;
+    MeshPtr mesh = polyanya->get_mesh();
+    if (!load_target_index(path, mesh->get_hash(), mesh->mesh_polygons.size(), index)) return false;
+    // removed goals of a TargetHeuristic snapshot are not in the tree
+    goals = std::move(index.goals);
+    srt = std::move(index.tree);
+    if (rte != nullptr) delete rte;
+    rte = nullptr;
+    rtEntries.clear();
+    gids.clear();
+    return true;
+  }
 }
@@ -4,6 +4,8 @@
 #include "timer.h"
 #include "RStarTree.h"
 #include "RStarTreeUtil.h"
+#include "StaticRTree.h"
+#include "targetindex.h"
 #include "knnMeshFence.h"
 #include <chrono>
 #include <queue>
@@ -33,7 +35,7 @@ class IERPolyanya {
         }
 
         void initRtree() {
-          assert(rte == nullptr);
+          if (rte != nullptr) delete rte;
           rte = new rs::RStarTree();
           rtEntries.clear();
           gids.clear();
@@ -45,8 +47,13 @@ class IERPolyanya {
             rtEntries.push_back(leaf);
           }
 
+          rs::Entry_P_V entryPtrs;
           for (auto& it: rtEntries)
-            rte->insertData(&it);
+            entryPtrs.push_back(&it);
+          rte->bulkLoad(entryPtrs);
+          srt.build(*rte);
+          // no attributes, but a snapshot of it is filtered by TargetHeuristic
+          srt.setMasks(std::vector<unsigned>(goals.size(), 0));
         }
 
         void init_search() {
@@ -67,6 +74,8 @@ class IERPolyanya {
         double rtree_cost;
         bool verbose;
         rs::RStarTree* rte = nullptr;
+        // flat copy of rte used by the queries, also what a snapshot holds
+        rs::StaticRTree srt;
         std::vector<rs::LeafNodeEntry> rtEntries;
         std::vector<int> gids;
 
@@ -87,6 +96,9 @@ class IERPolyanya {
           initRtree();
         }
         void set_start(Point s) { start = s; }
+        // Snapshot of the targets (see targetindex.h), shared with TargetHeuristic.
+        bool save_targets(const std::string& path);
+        bool load_targets(const std::string& path);
         void set_meshFence(KnnMeshEdgeFence* meshFence) { this->meshFence= meshFence; }
         vector<double> search();        
 };
@@ -7,8 +7,14 @@
 #include "point.h"
 #include "consts.h"
 #include <cassert>
+#include <cstdint>
 #include <vector>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POLYANYA_X86_KERNELS
+#include <immintrin.h>
+#endif
+
 namespace polyanya
 {
 
@@ -133,6 +139,244 @@ inline int binary_search(const std::vector<int>& arr, const int N,
     return best_so_far;
 }
 
+// Orientation masks.
+// Bit i of ccw is set iff dir_a * (V[i] - base_a) > EPSILON (strictly CCW),
+// bit i of cw is set iff dir_b * (V[i] - base_b) < -EPSILON (strictly CW).
+// The masks are only built for polygons with at most MAX_MASK_SIDES
+// vertices, so that the doubled mask (indices in [0, 2N)) fits in 64 bits.
+const int MAX_MASK_SIDES = 32;
+
+typedef void (*OrientFn)(const std::vector<int>& V,
+                         const std::vector<Vertex>& mesh_vertices,
+                         const Point& dir_a, const Point& base_a,
+                         const Point& dir_b, const Point& base_b,
+                         uint64_t& ccw, uint64_t& cw);
+
+static void orient_masks_scalar(const std::vector<int>& V,
+                                const std::vector<Vertex>& mesh_vertices,
+                                const Point& dir_a, const Point& base_a,
+                                const Point& dir_b, const Point& base_b,
+                                uint64_t& ccw, uint64_t& cw)
+{
+    ccw = cw = 0;
+    const int N = (int) V.size();
+    for (int i = 0; i < N; i++)
+    {
+        const Point& p = mesh_vertices[V[i]].p;
+        if (dir_a * (p - base_a) > EPSILON)
+        {
+            ccw |= uint64_t(1) << i;
+        }
+        if (dir_b * (p - base_b) < -EPSILON)
+        {
+            cw |= uint64_t(1) << i;
+        }
+    }
+}
+
+#ifdef POLYANYA_X86_KERNELS
+__attribute__((target("sse2")))
+static void orient_masks_sse2(const std::vector<int>& V,
+                              const std::vector<Vertex>& mesh_vertices,
+                              const Point& dir_a, const Point& base_a,
+                              const Point& dir_b, const Point& base_b,
+                              uint64_t& ccw, uint64_t& cw)
+{
+    ccw = cw = 0;
+    const int N = (int) V.size();
+    // Same operation order as Point::operator*, so every lane agrees
+    // bit-for-bit with the scalar kernel.
+    const __m128d ax = _mm_set1_pd(dir_a.x), ay = _mm_set1_pd(dir_a.y);
+    const __m128d bx = _mm_set1_pd(dir_b.x), by = _mm_set1_pd(dir_b.y);
+    const __m128d oax = _mm_set1_pd(base_a.x), oay = _mm_set1_pd(base_a.y);
+    const __m128d obx = _mm_set1_pd(base_b.x), oby = _mm_set1_pd(base_b.y);
+    const __m128d pos_eps = _mm_set1_pd(EPSILON);
+    const __m128d neg_eps = _mm_set1_pd(-EPSILON);
+    int i = 0;
+    for (; i + 2 <= N; i += 2)
+    {
+        const Point& p0 = mesh_vertices[V[i]].p;
+        const Point& p1 = mesh_vertices[V[i + 1]].p;
+        const __m128d px = _mm_set_pd(p1.x, p0.x);
+        const __m128d py = _mm_set_pd(p1.y, p0.y);
+        const __m128d ca = _mm_sub_pd(
+            _mm_mul_pd(ax, _mm_sub_pd(py, oay)),
+            _mm_mul_pd(ay, _mm_sub_pd(px, oax)));
+        const __m128d cb = _mm_sub_pd(
+            _mm_mul_pd(bx, _mm_sub_pd(py, oby)),
+            _mm_mul_pd(by, _mm_sub_pd(px, obx)));
+        ccw |= (uint64_t) _mm_movemask_pd(_mm_cmpgt_pd(ca, pos_eps)) << i;
+        cw |= (uint64_t) _mm_movemask_pd(_mm_cmplt_pd(cb, neg_eps)) << i;
+    }
+    for (; i < N; i++)
+    {
+        const Point& p = mesh_vertices[V[i]].p;
+        if (dir_a * (p - base_a) > EPSILON)
+        {
+            ccw |= uint64_t(1) << i;
+        }
+        if (dir_b * (p - base_b) < -EPSILON)
+        {
+            cw |= uint64_t(1) << i;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void orient_masks_avx2(const std::vector<int>& V,
+                              const std::vector<Vertex>& mesh_vertices,
+                              const Point& dir_a, const Point& base_a,
+                              const Point& dir_b, const Point& base_b,
+                              uint64_t& ccw, uint64_t& cw)
+{
+    ccw = cw = 0;
+    const int N = (int) V.size();
+    const __m256d ax = _mm256_set1_pd(dir_a.x), ay = _mm256_set1_pd(dir_a.y);
+    const __m256d bx = _mm256_set1_pd(dir_b.x), by = _mm256_set1_pd(dir_b.y);
+    const __m256d oax = _mm256_set1_pd(base_a.x);
+    const __m256d oay = _mm256_set1_pd(base_a.y);
+    const __m256d obx = _mm256_set1_pd(base_b.x);
+    const __m256d oby = _mm256_set1_pd(base_b.y);
+    const __m256d pos_eps = _mm256_set1_pd(EPSILON);
+    const __m256d neg_eps = _mm256_set1_pd(-EPSILON);
+    int i = 0;
+    for (; i + 4 <= N; i += 4)
+    {
+        const Point& p0 = mesh_vertices[V[i]].p;
+        const Point& p1 = mesh_vertices[V[i + 1]].p;
+        const Point& p2 = mesh_vertices[V[i + 2]].p;
+        const Point& p3 = mesh_vertices[V[i + 3]].p;
+        const __m256d px = _mm256_set_pd(p3.x, p2.x, p1.x, p0.x);
+        const __m256d py = _mm256_set_pd(p3.y, p2.y, p1.y, p0.y);
+        const __m256d ca = _mm256_sub_pd(
+            _mm256_mul_pd(ax, _mm256_sub_pd(py, oay)),
+            _mm256_mul_pd(ay, _mm256_sub_pd(px, oax)));
+        const __m256d cb = _mm256_sub_pd(
+            _mm256_mul_pd(bx, _mm256_sub_pd(py, oby)),
+            _mm256_mul_pd(by, _mm256_sub_pd(px, obx)));
+        ccw |= (uint64_t) _mm256_movemask_pd(
+            _mm256_cmp_pd(ca, pos_eps, _CMP_GT_OQ)) << i;
+        cw |= (uint64_t) _mm256_movemask_pd(
+            _mm256_cmp_pd(cb, neg_eps, _CMP_LT_OQ)) << i;
+    }
+    for (; i < N; i++)
+    {
+        const Point& p = mesh_vertices[V[i]].p;
+        if (dir_a * (p - base_a) > EPSILON)
+        {
+            ccw |= uint64_t(1) << i;
+        }
+        if (dir_b * (p - base_b) < -EPSILON)
+        {
+            cw |= uint64_t(1) << i;
+        }
+    }
+}
+#endif
+
+static OrientKernel resolve_kernel(OrientKernel kernel)
+{
+    #ifdef POLYANYA_X86_KERNELS
+    if (kernel == OrientKernel::AUTO)
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return OrientKernel::AVX2;
+        }
+        return __builtin_cpu_supports("sse2") ? OrientKernel::SSE2 :
+                                                OrientKernel::SCALAR;
+    }
+    if (kernel == OrientKernel::AVX2 && !__builtin_cpu_supports("avx2"))
+    {
+        return OrientKernel::SSE2;
+    }
+    return kernel;
+    #else
+    // Only the portable kernels are compiled in.
+    if (kernel == OrientKernel::AUTO || kernel == OrientKernel::SSE2 ||
+        kernel == OrientKernel::AVX2)
+    {
+        return OrientKernel::SCALAR;
+    }
+    return kernel;
+    #endif
+}
+
+static OrientKernel orient_kernel = resolve_kernel(OrientKernel::AUTO);
+
+static OrientFn orient_fn_for(OrientKernel kernel)
+{
+    switch (kernel)
+    {
+        #ifdef POLYANYA_X86_KERNELS
+        case OrientKernel::SSE2:
+            return orient_masks_sse2;
+        case OrientKernel::AVX2:
+            return orient_masks_avx2;
+        #endif
+        case OrientKernel::SCALAR:
+            return orient_masks_scalar;
+        default:
+            return nullptr;
+    }
+}
+
+static OrientFn orient_masks = orient_fn_for(orient_kernel);
+
+OrientKernel set_orient_kernel(OrientKernel kernel)
+{
+    orient_kernel = resolve_kernel(kernel);
+    orient_masks = orient_fn_for(orient_kernel);
+    return orient_kernel;
+}
+
+OrientKernel get_orient_kernel()
+{
+    return orient_kernel;
+}
+
+const char* orient_kernel_name(OrientKernel kernel)
+{
+    switch (kernel)
+    {
+        case OrientKernel::AUTO:
+            return "auto";
+        case OrientKernel::BINARY_SEARCH:
+            return "bsearch";
+        case OrientKernel::SCALAR:
+            return "scalar";
+        case OrientKernel::SSE2:
+            return "sse2";
+        case OrientKernel::AVX2:
+            return "avx2";
+        default:
+            return "";
+    }
+}
+
+// Mask counterpart of binary_search.
+// mask holds the predicate for the N polygon vertices, and lower/upper are in
+// the range [0, 2 * N - 1] like for binary_search. Returns the first (lower
+// bound) or last (upper bound) index within [lower, upper] matching the
+// predicate, or -1 if there is none.
+inline int mask_search(const uint64_t mask, const int N, int lower, int upper,
+                       const bool is_upper_bound)
+{
+    if (lower == upper) return lower;
+    if (lower > upper) return -1;
+    const uint64_t doubled = mask | (mask << N);
+    const int len = upper - lower + 1;
+    const uint64_t window = (doubled >> lower) &
+        (len >= 64 ? ~uint64_t(0) : (uint64_t(1) << len) - 1);
+    if (!window) return -1;
+    if (is_upper_bound)
+    {
+        return lower + 63 - __builtin_clzll(window);
+    }
+    return lower + __builtin_ctzll(window);
+}
+
 // TODO: Wrap this in a class so we don't have to keep passing the same params
 // over and over again
 // Generates the successors of the search node and sets them in the successor
@@ -497,6 +741,16 @@ int get_successors(SearchNode& node, const Point& start, const Mesh& mesh,
     // Macro for getting a point from a polygon point index.
     #define index2point(index) mesh_vertices[V[index]].p
 
+    // Classify every vertex against both the root-right and root-left rays
+    // at once when a mask kernel is in use.
+    const bool use_masks = orient_masks != nullptr && N <= MAX_MASK_SIDES;
+    uint64_t ccw_of_right = 0, cw_of_left = 0;
+    if (use_masks)
+    {
+        orient_masks(V, mesh_vertices, node.right - root, node.right,
+                     node.left - root, node.left, ccw_of_right, cw_of_left);
+    }
+
     // find the transition between non-observable-right and observable.
     // we will call this A, defined by:
     // "first P such that root-right-p is strictly CCW".
@@ -519,6 +773,11 @@ int get_successors(SearchNode& node, const Point& start, const Mesh& mesh,
                 return right_ind + 1;
             }
         }
+        if (use_masks)
+        {
+            return mask_search(ccw_of_right, N, right_ind + 1, left_ind,
+                               false);
+        }
         return binary_search(V, N, mesh_vertices, right_ind + 1, left_ind,
             [&root_right, &node](const Vertex& v)
             {
@@ -556,6 +815,10 @@ int get_successors(SearchNode& node, const Point& start, const Mesh& mesh,
                 return left_ind - 1;
             }
         }
+        if (use_masks)
+        {
+            return mask_search(cw_of_left, N, A - 1, left_ind - 1, true);
+        }
         return binary_search(V, N, mesh_vertices, A - 1, left_ind - 1,
             [&root_left, &node](const Vertex& v)
             {
@@ -1,3 +1,4 @@
+#pragma once
 #include "searchnode.h"
 #include "successor.h"
 #include "mesh.h"
@@ -20,5 +21,24 @@ double get_interval_heuristic(const Point& root, const Point& l, const Point& r)
 int get_successors(SearchNode& node, const Point& start, const Mesh& mesh,
                    Successor* successors);
 
+// Kernels used by get_successors to find the observable range.
+// BINARY_SEARCH runs two binary searches over the polygon vertices; the
+// others evaluate the root-vertex orientation of every vertex in one pass
+// and read both transitions off the resulting bitmasks.
+// AUTO picks the widest kernel supported by the running CPU.
+enum struct OrientKernel
+{
+    AUTO,
+    BINARY_SEARCH,
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+// Returns the kernel actually in use (never AUTO).
+OrientKernel set_orient_kernel(OrientKernel kernel);
+OrientKernel get_orient_kernel();
+const char* orient_kernel_name(OrientKernel kernel);
+
 PointLocation get_point_location_in_search(Point& p, Mesh* mesh, bool verbose);
 }
@@ -90,6 +90,42 @@ void FenceHeuristic::set_end_polygon() {
     assert(poly_id < (int)end_polygons.size());
     end_polygons[poly_id].push_back(i);
   }
+  end_index.build(end_polygons, goals);
+}
+
+void FenceHeuristic::set_start_bound() {
+  // The start sees every point of the edges of its polygon, so for a fence
+  // on one of them g + |inner, p| + |p, start| is the length of a path to
+  // its goal, for p an end point of the fence interval.  The interval is
+  // kept in floats; the slack covers moving p by that rounding.
+  start_bound = INF;
+  if (meshFence == nullptr || meshFence->is_lazy()) return;
+  const PointLocation pl = get_point_location_in_search(start, mesh, verbose);
+  if (pl.poly1 == -1) return;
+  const Polygon& poly = mesh->mesh_polygons[pl.poly1];
+  const int n = poly.vertices.size();
+  std::vector<std::pair<int, double>> ubs;
+  for (int i=0; i<n; i++) {
+    const int a = poly.vertices[i? i-1: n-1], b = poly.vertices[i];
+    const double slack = 1e-6 * mesh->mesh_vertices[a].p.distance(mesh->mesh_vertices[b].p) + EPSILON;
+    for (const Fence& it: meshFence->get_fences(poly.edges[i])) {
+      const Point& inner = it.root == -1? goals[it.gid]: mesh->mesh_vertices[it.root].p;
+      Point left, right;
+      meshFence->get_interval(it, a, b, left, right);
+      const double ub = it.g + std::min(inner.distance(left) + left.distance(start),
+                                        inner.distance(right) + right.distance(start)) + slack;
+      ubs.push_back({it.gid, ub});
+    }
+  }
+  if ((int)ubs.size() < K) return;
+  // best bound of each goal, then the k-th of those
+  std::sort(ubs.begin(), ubs.end());
+  std::vector<double> best;
+  for (size_t i=0; i<ubs.size(); i++)
+    if (i == 0 || ubs[i].first != ubs[i-1].first) best.push_back(ubs[i].second);
+  if ((int)best.size() < K) return;
+  std::nth_element(best.begin(), best.begin() + K - 1, best.end());
+  start_bound = best[K-1];
 }
 
 void FenceHeuristic::push_lazy(SearchNodePtr lazy) {
@@ -103,6 +139,7 @@ void FenceHeuristic::push_lazy(SearchNodePtr lazy) {
       const Point& goal = goals[gid];
       SearchNodePtr final_node = get_lazy(lazy->next_polygon, lazy->left_vertex, lazy->right_vertex);
       final_node->f += start.distance(goal);
+      kth_bound.add(gid, final_node->f);
       final_node->set_reached();
       final_node->set_goal_id(gid);
 
@@ -245,6 +282,7 @@ int FenceHeuristic::search() {
     nodes_popped++;
     if (node->reached) {
       deal_final_node(node);
+      free_node(node);
       if ((int)final_nodes.size() == K) break;
       continue;
     }
@@ -262,12 +300,15 @@ int FenceHeuristic::search() {
           #ifndef NDEBUG
           if (verbose) std::cerr << "node is dominated!" << std::endl;
           #endif
+          free_node(node);
           continue;
         }
       }
     }
     int num_nodes = 1;
     search_nodes_to_push[0] = *node;
+    const SearchNodePtr popped = node;
+    SearchNode turned;
     // Intermediate pruning
     do {
       SearchNode cur = search_nodes_to_push[0];
@@ -279,16 +320,22 @@ int FenceHeuristic::search() {
         if (cur.g != search_nodes_to_push[0].g) {
           // Turned. Set the parent of this, and set the current
           // node pointer to this after allocating space for it.
-          search_nodes_to_push[0].parent = node;
-          node = new (node_pool->allocate()) SearchNode(search_nodes_to_push[0]);
+          // Without paths nothing refers to it, so a copy will do.
+          if (distance_only) {
+            turned = search_nodes_to_push[0];
+            node = &turned;
+          } else {
+            search_nodes_to_push[0].parent = node;
+            node = new (node_pool->allocate()) SearchNode(search_nodes_to_push[0]);
+          }
           node->f = search_nodes_to_push[0].f;
           nodes_generated++;
         }
         if (!end_polygons[search_nodes_to_push[0].next_polygon].empty()) {
-          const SearchNodePtr nxt = new (node_pool->allocate()) SearchNode(search_nodes_to_push[0]);
-          nxt->parent = node;
-          const Point& nxt_root = nxt->root == -1? start: mesh->mesh_vertices[nxt->root].p;
-          gen_final_nodes(nxt, nxt_root);
+          SearchNode nxt = search_nodes_to_push[0];
+          nxt.parent = distance_only? nullptr: node;
+          const Point& nxt_root = nxt.root == -1? start: mesh->mesh_vertices[nxt.root].p;
+          gen_final_nodes(&nxt, nxt_root);
         }
         #ifndef NDEBUG
         if (verbose) {
@@ -312,11 +359,18 @@ int FenceHeuristic::search() {
         gen_final_nodes(nxt, nxt_root);
       }
 
-      if (fence_h.first == -1) continue;
+      if (fence_h.first == -1) {
+        free_node(nxt);
+        continue;
+      }
       nxt->f = fence_h.second + nxt->g;
       // manually guarantee the consistency
       nxt->f = max(nxt->f, node->f);
-      nxt->parent = node;
+      if (nxt->f > start_bound + EPSILON) {
+        free_node(nxt);
+        continue;
+      }
+      nxt->parent = distance_only? nullptr: node;
       #ifndef NDEBUG
       if (verbose) {
         std::cerr << "\tpushing: ";
@@ -328,8 +382,11 @@ int FenceHeuristic::search() {
       nodes_pushed++;
       nodes_generated++;
     }
+    free_node(popped);
   }
   timer.stop();
+  // regions this search found cold are built for the next one
+  if (meshFence->is_lazy()) meshFence->warm_up();
   return (int)final_nodes.size();
 }
 
@@ -373,7 +430,7 @@ void FenceHeuristic::deal_final_node(const SearchNodePtr node) {
 
   const Point& goal = goals[node->goal_id];
   const int final_root = [&]() {
-      const Point& root = root_to_point(node->root);
+      const Point root = root_to_point(node->root);
       const Point root_goal = goal - root;
       // If root-left-goal is not CW, use left.
       if (root_goal * (node->left - root) < -EPSILON) {
@@ -396,7 +453,7 @@ void FenceHeuristic::deal_final_node(const SearchNodePtr node) {
     int end_polygon = node->next_polygon;
     const SearchNodePtr true_final =
       new (node_pool->allocate()) SearchNode
-      {node, final_root, goal, goal, -1, -1, end_polygon, node->f, node->g};
+      {distance_only? nullptr: node, final_root, goal, goal, -1, -1, end_polygon, node->f, node->g};
     true_final->set_reached();
     true_final->set_goal_id(node->goal_id);
     reached[node->goal_id] = node->f;
@@ -418,81 +475,95 @@ void FenceHeuristic::deal_final_node(const SearchNodePtr node) {
 }
 
 void FenceHeuristic::gen_final_nodes(const SearchNodePtr node, const Point& rootPoint) {
-    for (int gid: end_polygons[node->next_polygon]) {
+    // Goals are visited nearest first and only generated while
+    // g + |root, goal| can still beat the k-th best path found so far.
+    const auto visit = [&](int gid) {
       const Point& goal = goals[gid];
+      if (fabs(reached[gid] - INF) > EPSILON ||
+          node->g + rootPoint.distance(goal) > get_bound())
+        return get_bound() - node->g;
       SearchNodePtr final_node = new (node_pool->allocate()) SearchNode(*node);
       final_node->set_reached();
       final_node->set_goal_id(gid);
       final_node->f = final_node->g + get_h_value(rootPoint, goal, node->left, node->right);
-      if (fabs(reached[gid] - INF) < EPSILON) {
-        #ifndef NDEBUG
-        if (verbose) {
-          std::cerr << "\tpushing: ";
-          print_node(final_node, std::cerr);
-          std::cerr << std::endl;
-        }
-        #endif
-        open_list.push(final_node);
-        nodes_generated++;
-        nodes_pushed++;
+      kth_bound.add(gid, final_node->f);
+      #ifndef NDEBUG
+      if (verbose) {
+        std::cerr << "\tpushing: ";
+        print_node(final_node, std::cerr);
+        std::cerr << std::endl;
       }
-      //else assert(reached[gid] <= final_node->f + EPSILON);
-    }
+      #endif
+      open_list.push(final_node);
+      nodes_generated++;
+      nodes_pushed++;
+      return get_bound() - node->g;
+    };
+    end_index.scan(node->next_polygon, rootPoint, get_bound() - node->g, visit);
 }
 
-std::pair<int, double> FenceHeuristic::nn_query(SearchInstance* si, double& elapsed_time_micro) {
-  // only support nearest neighbour query
-  // return {target_id, dist}
-  std::pair<int, double> res = {-1, INF};
-  assert(meshFence != nullptr);
-  init_search();
-  this->K = 1;
-  while (!open_list.empty()) {
-    SearchNodePtr node = open_list.top(); open_list.pop();
-    nodes_popped++;
-    if (node->reached) {
-      if (node->f < res.second) {
-        res.second = node->f;
-        res.first = node->goal_id;
-      }
-      continue;
-    }
-    assert(node->root == -1);
-    std::vector<Fence> fences = meshFence->get_fences(node->left_vertex, node->right_vertex);
-    for (const auto& it: fences) {
-      Point goal = it.s.root == -1? goals[it.gid]: mesh->mesh_vertices[it.s.root].p;
-      //Point goal = goals[it.gid];
-      si->verbose=false;
-      si->set_start_goal(start, goal);
-      si->search();
-      elapsed_time_micro += si->get_search_micro();
-      nodes_generated += si->nodes_generated;
-      nodes_popped += si->nodes_popped;
-      nodes_pushed += si->nodes_pushed;
-      double start_to_root = si->get_cost();
-      double dist = it.s.g + start_to_root;
-      //double dist = si->get_cost();
-      if (dist < res.second) {
-        res.second = dist;
-        res.first = it.gid;
-      }
-    }
-  }
-  return res;
+std::pair<int, double> FenceHeuristic::nn_query(double& elapsed_time_micro) {
+  // the kNN search with k = 1, {target_id, dist}
+  const int k = K;
+  K = 1;
+  const int res = search();
+  K = k;
+  elapsed_time_micro += get_search_micro();
+  if (res == 0) return {-1, INF};
+  return {(int)get_gid(0), get_cost(0)};
 }
 
 pair<int, double> FenceHeuristic::get_fence_heuristic(SearchNode* node) {
-  vector<Fence> fences = meshFence->get_fences(node->left_vertex, node->right_vertex);
   int heuristic_gid = -1;
   double hValue = INF;
-  for (auto& it: fences) {
-    const Point& inner = it.s.root == -1? goals[it.gid]: mesh->mesh_vertices[it.s.root].p;
-    double tmph = it.s.g + get_h_value(root_to_point(node->root), inner, node->left, node->right);
+  const int edge = meshFence->get_edge(node->next_polygon, node->left_vertex, node->right_vertex);
+  if (edge == -1) return {heuristic_gid, hValue};
+  const Point root = root_to_point(node->root);
+  // a fence gives at least key + |root, interval|
+  const double base = root.distance_to_seg(node->left, node->right);
+  // With fences of depth d the goals already reached can be skipped until
+  // d of them are: any other goal without a fence here has d nearer ones.
+  const bool skip_reached = (int)final_nodes.size() < meshFence->get_fence_depth();
+  // Fences dropped by a budget, and in lazy mode or past the bound of a
+  // hierarchy the goals without fences there, are at least rest away from
+  // the edge.  The gid stays that of the best fence unless there is none.
+  double rest;
+  int rest_gid = -1;
+  FenceRange fences;
+  if (meshFence->is_lazy()) {
+    fences = meshFence->get_lazy_fences(edge, rest, rest_gid);
+  } else {
+    fences = meshFence->get_fences(edge);
+    rest = meshFence->get_rest_lb(edge);
+  }
+  // The coarse bound first: the fences give at most base + rest, so they
+  // are only scanned where the coarse bound is below that.
+  double coarse = 0;
+  int coarse_gid = -1;
+  if (meshFence->has_coarse()) {
+    coarse = meshFence->get_coarse_bound(node->next_polygon, root, base, coarse_gid);
+    if (coarse >= base + rest) return {coarse_gid, coarse};
+  }
+  for (const Fence& it: fences) {
+    if (it.key + base >= hValue) break;
+    if (skip_reached && reached[it.gid] < INF) continue;
+    const Point& inner = it.root == -1? goals[it.gid]: mesh->mesh_vertices[it.root].p;
+    double tmph = it.g + get_h_value(root, inner, node->left, node->right);
     if (tmph < hValue) {
       hValue = tmph;
       heuristic_gid = it.gid;
     }
   }
+  if (rest < hValue) {
+    hValue = min(hValue, base + rest);
+    if (heuristic_gid == -1) heuristic_gid = rest_gid != -1? rest_gid:
+                                             fences.empty()? meshFence->get_live_goal(): fences[0].gid;
+  }
+  // a node without a fence gid is pruned, so the coarse one stands in
+  if (coarse > hValue || (heuristic_gid == -1 && coarse_gid != -1)) {
+    hValue = max(hValue, coarse);
+    heuristic_gid = coarse_gid;
+  }
   return {heuristic_gid, hValue};
 }
 
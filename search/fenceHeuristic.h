@@ -6,6 +6,7 @@
 #include "successor.h"
 #include "mesh.h"
 #include "point.h"
+#include "endpolygons.h"
 #include "cpool.h"
 #include "timer.h"
 #include "RStarTree.h"
@@ -25,6 +26,8 @@ class FenceHeuristic {
                                 PointerComp<SearchNode> > pq;
     private:
         int K = 1;
+        // Only keep distances: no parent links, popped nodes are recycled.
+        bool distance_only = false;
         warthog::mem::cpool* node_pool;
         MeshPtr mesh;
         Point start;
@@ -35,6 +38,12 @@ class FenceHeuristic {
         std::vector<SearchNodePtr> final_nodes;
         // poly_id: goal1, goal2, ...
         std::vector<std::vector<int>> end_polygons;
+        // sub-index of end_polygons and k-th best bound for gen_final_nodes
+        EndPolygonIndex end_index;
+        KthBound kth_bound;
+        // k-th best upper bound over the goals fenced on the edges of the
+        // start polygon; nodes beyond it are not pushed.
+        double start_bound;
         // <i, v>: reached ith goal with cost v
         //std::map<int, double> reached;
         std::vector<double> reached;
@@ -87,12 +96,18 @@ class FenceHeuristic {
             nodes_pruned_post_pop = 0;
             successor_calls = 0;
             nodes_reevaluate = 0;
+            kth_bound.reset(K, (int)goals.size());
+            set_start_bound();
             gen_initial_nodes();
             heuristic_using = 0;
             heuristic_call = 0;
             angle_using = 0;
         }
         void set_end_polygon();
+        void set_start_bound();
+        double get_bound() const {
+          return std::min(kth_bound.get(), start_bound);
+        }
         void gen_initial_nodes();
         int succ_to_node(
             SearchNodePtr parent, Successor* successors,
@@ -100,6 +115,9 @@ class FenceHeuristic {
         );
         void push_lazy(SearchNodePtr lazy);
         void print_node(SearchNodePtr node, std::ostream& outfile);
+        void free_node(SearchNodePtr node) {
+          if (distance_only) node_pool->deallocate((char*)node);
+        }
         inline Point root_to_point(int root_id) {
           return root_id == -1? start: mesh->mesh_vertices[root_id].p;
         }
@@ -131,6 +149,11 @@ class FenceHeuristic {
 
         void set_K(int k) { this->K = k; }
 
+        void set_distance_only(bool flag) { this->distance_only = flag; }
+
+        // Most search nodes held in memory at once during the last search.
+        size_t get_peak_live() { return node_pool->peak_live(); }
+
         void set_goals(std::vector<Point> gs) {
           goals = std::vector<Point>(gs);
           set_end_polygon();
@@ -140,6 +163,8 @@ class FenceHeuristic {
 
         void set_meshFence(KnnMeshEdgeFence* meshFence) { this->meshFence= meshFence; }
 
+        // The k nearest targets in one search, fastest with fences of depth
+        // at least k.
         int search();
 
         double get_cost(int k) {
@@ -177,7 +202,9 @@ class FenceHeuristic {
           return -1;
         }
 
-        std::pair<int, double> nn_query(SearchInstance* si, double& elapsed_time_micro);
+        // The nearest target as {gid, dist}, {-1, INF} if none is
+        // reachable: search() with k = 1, K is left as it was.
+        std::pair<int, double> nn_query(double& elapsed_time_micro);
 };
 
 }
@@ -89,6 +89,7 @@ void IntervalHeuristic::set_end_polygon() {
     assert(poly_id < (int)end_polygons.size());
     end_polygons[poly_id].push_back(i);
   }
+  end_index.build(end_polygons, goals);
 }
 
 void IntervalHeuristic::gen_initial_nodes() {
@@ -110,6 +111,7 @@ void IntervalHeuristic::gen_initial_nodes() {
         const Point& goal = goals[gid];
         SearchNodePtr final_node = get_lazy(lazy->next_polygon, lazy->left_vertex, lazy->right_vertex);
         final_node->f += start.distance(goal);
+        kth_bound.add(gid, final_node->f);
         final_node->set_reached();
         final_node->set_goal_id(gid);
 
@@ -240,6 +242,7 @@ int IntervalHeuristic::search() {
     nodes_popped++;
     if (node->reached) {
       deal_final_node(node);
+      free_node(node);
       if ((int)final_nodes.size() == K) break;
       continue;
     }
@@ -255,12 +258,15 @@ int IntervalHeuristic::search() {
           #ifndef NDEBUG
           if (verbose) std::cerr << "node is dominated!" << std::endl;
           #endif
+          free_node(node);
           continue;
         }
       }
     }
     int num_nodes = 1;
     search_nodes_to_push[0] = *node;
+    const SearchNodePtr popped = node;
+    SearchNode turned;
     // Intermediate pruning
     do {
       SearchNode cur = search_nodes_to_push[0];
@@ -273,15 +279,21 @@ int IntervalHeuristic::search() {
         if (cur.g != search_nodes_to_push[0].g) {
           // Turned. Set the parent of this, and set the current
           // node pointer to this after allocating space for it.
-          search_nodes_to_push[0].parent = node;
-          node = new (node_pool->allocate()) SearchNode(search_nodes_to_push[0]);
+          // Without paths nothing refers to it, so a copy will do.
+          if (distance_only) {
+            turned = search_nodes_to_push[0];
+            node = &turned;
+          } else {
+            search_nodes_to_push[0].parent = node;
+            node = new (node_pool->allocate()) SearchNode(search_nodes_to_push[0]);
+          }
           nodes_generated++;
         }
         if (!end_polygons[search_nodes_to_push[0].next_polygon].empty()) {
-          const SearchNodePtr nxt = new (node_pool->allocate()) SearchNode(search_nodes_to_push[0]);
-          nxt->parent = node;
-          const Point& nxt_root = nxt->root == -1? start: mesh->mesh_vertices[nxt->root].p;
-          gen_final_nodes(nxt, nxt_root);
+          SearchNode nxt = search_nodes_to_push[0];
+          nxt.parent = distance_only? nullptr: node;
+          const Point& nxt_root = nxt.root == -1? start: mesh->mesh_vertices[nxt.root].p;
+          gen_final_nodes(&nxt, nxt_root);
         }
         #ifndef NDEBUG
         if (verbose) {
@@ -299,7 +311,7 @@ int IntervalHeuristic::search() {
       const Point& nxt_root = (nxt->root == -1 ? start: mesh->mesh_vertices[nxt->root].p);
 			if (!this->isZero)
 				nxt->f += get_interval_heuristic(nxt_root, nxt->left, nxt->right);
-      nxt->parent = node;
+      nxt->parent = distance_only? nullptr: node;
       #ifndef NDEBUG
       if (verbose) {
         std::cerr << "\tpushing: ";
@@ -317,6 +329,7 @@ int IntervalHeuristic::search() {
         gen_final_nodes(nxt, nxt_root);
       }
     }
+    free_node(popped);
   }
   timer.stop();
   return (int)final_nodes.size();
@@ -382,7 +395,7 @@ void IntervalHeuristic::deal_final_node(const SearchNodePtr node) {
     int end_polygon = node->next_polygon;
     const SearchNodePtr true_final =
       new (node_pool->allocate()) SearchNode
-      {node, final_root, goal, goal, -1, -1, end_polygon, node->f, node->g};
+      {distance_only? nullptr: node, final_root, goal, goal, -1, -1, end_polygon, node->f, node->g};
     true_final->set_reached();
     true_final->set_goal_id(node->goal_id);
     reached[node->goal_id] = node->f;
@@ -393,12 +406,18 @@ void IntervalHeuristic::deal_final_node(const SearchNodePtr node) {
 
 void IntervalHeuristic::gen_final_nodes(const SearchNodePtr node, const Point& rootPoint) {
     assert(node->next_polygon != -1);
-    for (int gid: end_polygons[node->next_polygon]) {
+    // Goals are visited nearest first and only generated while
+    // g + |root, goal| can still beat the k-th best path found so far.
+    const auto visit = [&](int gid) {
       const Point& goal = goals[gid];
+      if (reached.find(gid) != reached.end() ||
+          node->g + rootPoint.distance(goal) > kth_bound.get())
+        return kth_bound.get() - node->g;
       SearchNodePtr final_node = new (node_pool->allocate()) SearchNode(*node);
       final_node->set_reached();
       final_node->set_goal_id(gid);
       final_node->f = final_node->g + get_h_value(rootPoint, goal, node->left, node->right);
+      kth_bound.add(gid, final_node->f);
       #ifndef NDEBUG
       if (verbose) {
         std::cerr << "\tpushing: ";
@@ -409,7 +428,9 @@ void IntervalHeuristic::gen_final_nodes(const SearchNodePtr node, const Point& r
       open_list.push(final_node);
       nodes_generated++;
       nodes_pushed++;
-    }
+      return kth_bound.get() - node->g;
+    };
+    end_index.scan(node->next_polygon, rootPoint, kth_bound.get() - node->g, visit);
 }
 
 #undef root_to_point
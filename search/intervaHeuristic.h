@@ -4,6 +4,7 @@
 #include "successor.h"
 #include "mesh.h"
 #include "point.h"
+#include "endpolygons.h"
 #include "cpool.h"
 #include "timer.h"
 #include <queue>
@@ -17,6 +18,8 @@ class IntervalHeuristic{
                                 PointerComp<SearchNode> > pq;
     private:
         int K = 1;
+        // Only keep distances: no parent links, popped nodes are recycled.
+        bool distance_only = false;
         warthog::mem::cpool* node_pool;
         MeshPtr mesh;
         Point start;
@@ -26,6 +29,9 @@ class IntervalHeuristic{
         std::vector<SearchNodePtr> final_nodes;
         // poly_id: goal1, goal2, ...
         std::vector<std::vector<int>> end_polygons;
+        // sub-index of end_polygons and k-th best bound for gen_final_nodes
+        EndPolygonIndex end_index;
+        KthBound kth_bound;
         // <i, v>: reached ith goal with cost v
         std::map<int, double> reached;
         pq open_list;
@@ -73,6 +79,7 @@ class IntervalHeuristic{
             nodes_popped = 0;
             nodes_pruned_post_pop = 0;
             successor_calls = 0;
+            kth_bound.reset(K, (int)goals.size());
             gen_initial_nodes();
         }
         void set_end_polygon();
@@ -83,6 +90,9 @@ class IntervalHeuristic{
         );
 
         void print_node(SearchNodePtr node, std::ostream& outfile);
+        void free_node(SearchNodePtr node) {
+          if (distance_only) node_pool->deallocate((char*)node);
+        }
 
     public:
         int nodes_generated;        // Nodes stored in memory
@@ -108,6 +118,11 @@ class IntervalHeuristic{
 
         void set_K(int k) { this->K = k; }
 
+        void set_distance_only(bool flag) { this->distance_only = flag; }
+
+        // Most search nodes held in memory at once during the last search.
+        size_t get_peak_live() { return node_pool->peak_live(); }
+
         void set_start_goal(Point s, std::vector<Point> gs) {
             start = s;
             goals.clear();
@@ -0,0 +1,200 @@
+#include "knnbatch.h"
+#include "targetHeuristic.h"
+#include "expansion.h"
+#include "mesh.h"
+#include "point.h"
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+namespace polyanya
+{
+
+// Position of cell (x, y) along the Hilbert curve filling a n * n grid,
+// n a power of two.
+static unsigned long long hilbert_index(unsigned n, unsigned x, unsigned y)
+{
+    unsigned long long d = 0;
+    for (unsigned s = n / 2; s > 0; s /= 2)
+    {
+        const unsigned rx = (x & s) > 0;
+        const unsigned ry = (y & s) > 0;
+        d += (unsigned long long) s * s * ((3 * rx) ^ ry);
+        // rotate the quadrant
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+KnnBatch::KnnBatch(MeshPtr m, TargetHeuristic* t, int threads) :
+    mesh(m), targets(t), num_threads(threads)
+{
+    distance_only = true;
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+    for (int i = 0; i < num_threads; i++)
+    {
+        workers.push_back(new TargetHeuristic(mesh));
+    }
+}
+
+KnnBatch::~KnnBatch()
+{
+    for (TargetHeuristic* w : workers)
+    {
+        delete w;
+    }
+}
+
+void KnnBatch::run_worker(int id, int k, unsigned filter, const std::vector<Point>& starts,
+                          const std::vector<int>& order, std::vector<KnnResult>& out)
+{
+    TargetHeuristic& w = *workers[id];
+    w.set_K(k);
+    w.set_distance_only(distance_only);
+    const int num = (int) order.size();
+    for (int run = next_run.fetch_add(1); run * RUN_SIZE < num;
+         run = next_run.fetch_add(1))
+    {
+        const int last = std::min(num, (run + 1) * RUN_SIZE);
+        // The previous query of the run: a start in the same polygon is
+        // located without a walk, and as the polygon is convex its k-th
+        // distance is at most that of the previous one plus |prev, start|.
+        PointLocation prev_loc = {PointLocation::NOT_ON_MESH, -1, -1, -1, -1};
+        Point prev;
+        double prev_kth = INF;
+        for (int i = run * RUN_SIZE; i < last; i++)
+        {
+            const int q = order[i];
+            Point start = starts[q];
+            PointLocation loc;
+            double bound = INF;
+            if (prev_loc.type == PointLocation::IN_POLYGON &&
+                mesh->poly_contains_point(prev_loc.poly1, start).type == PolyContainment::INSIDE)
+            {
+                loc = prev_loc;
+                bound = prev_kth + prev.distance(start) + EPSILON;
+                located++;
+            }
+            else
+            {
+                loc = get_point_location_in_search(start, mesh, false);
+            }
+            w.set_start(start, loc, bound);
+            const int found = w.search(filter);
+            prev_loc = loc;
+            prev = start;
+            prev_kth = found == k ? w.get_cost(k - 1) : INF;
+            KnnResult& res = out[q];
+            res.gids.resize(found);
+            res.dists.resize(found);
+            for (int j = 0; j < found; j++)
+            {
+                res.gids[j] = (int) w.get_gid(j);
+                res.dists[j] = w.get_cost(j);
+            }
+            res.nodes_generated = w.nodes_generated;
+            res.nodes_pushed = w.nodes_pushed;
+            res.nodes_popped = w.nodes_popped;
+            res.heuristic_call = w.heuristic_call;
+            res.search_micro = w.get_search_micro();
+            res.heuristic_micro = w.get_heuristic_micro();
+            res.duplicate = false;
+        }
+    }
+}
+
+void KnnBatch::search(const std::vector<Point>& starts, int k, std::vector<KnnResult>& out,
+                      unsigned filter)
+{
+    timer.start();
+    const int num = (int) starts.size();
+    out.assign(num, KnnResult());
+
+    // Workers read the targets of the caller, nothing is copied.
+    for (TargetHeuristic* w : workers)
+    {
+        w->share_targets(*targets);
+    }
+    located = 0;
+
+    // Hilbert order over a 2^16 grid on the bounding box of the mesh.
+    const unsigned n = 1 << 16;
+    const double minx = mesh->get_minx(), miny = mesh->get_miny();
+    const double w = std::max(mesh->get_maxx() - minx, EPSILON);
+    const double h = std::max(mesh->get_maxy() - miny, EPSILON);
+    const auto cell = [&](double v, double lo, double len)
+    {
+        const double c = (v - lo) / len * (n - 1);
+        return (unsigned) std::min(std::max(c, 0.0), (double) (n - 1));
+    };
+    std::vector<std::pair<unsigned long long, int>> keyed(num);
+    for (int i = 0; i < num; i++)
+    {
+        keyed[i] = {hilbert_index(n, cell(starts[i].x, minx, w),
+                                  cell(starts[i].y, miny, h)), i};
+    }
+    std::sort(keyed.begin(), keyed.end());
+
+    // Equal points share a cell, so they are next to each other: keep
+    // the first, answer the others with its result afterwards.
+    std::vector<int> order;
+    std::vector<int> same(num, -1);
+    for (int i = 0; i < num; i++)
+    {
+        const int q = keyed[i].second;
+        int j = i - 1;
+        for (; j >= 0 && keyed[j].first == keyed[i].first; j--)
+        {
+            if (starts[keyed[j].second] == starts[q])
+            {
+                break;
+            }
+        }
+        if (j >= 0 && keyed[j].first == keyed[i].first)
+        {
+            const int first = keyed[j].second;
+            same[q] = same[first] == -1 ? first : same[first];
+        }
+        else
+        {
+            order.push_back(q);
+        }
+    }
+
+    next_run.store(0);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; i++)
+    {
+        threads.emplace_back(&KnnBatch::run_worker, this, i, k, filter,
+                             std::cref(starts), std::cref(order), std::ref(out));
+    }
+    run_worker(0, k, filter, starts, order, out);
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+
+    for (int q = 0; q < num; q++)
+    {
+        if (same[q] != -1)
+        {
+            out[q] = out[same[q]];
+            out[q].duplicate = true;
+        }
+    }
+    timer.stop();
+}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "targetHeuristic.h"
+#include "mesh.h"
+#include "point.h"
+#include "timer.h"
+#include <atomic>
+#include <vector>
+
+namespace polyanya
+{
+
+// Result of one query of a batch, with the stats of its search.
+struct KnnResult
+{
+    std::vector<int> gids;
+    std::vector<double> dists;
+    int nodes_generated;
+    int nodes_pushed;
+    int nodes_popped;
+    int heuristic_call;
+    double search_micro;
+    double heuristic_micro;
+    // answered by an earlier query of the batch at the same point
+    bool duplicate;
+};
+
+// Batched kNN queries against the targets of one TargetHeuristic.
+//
+// Every worker keeps its own TargetHeuristic (node pool, open list, reached
+// counts) reading the targets and R-tree of the caller's one, which must
+// not change during a batch.  Queries are sorted along a Hilbert curve and
+// handed out in runs of consecutive queries, so a worker answers nearby
+// queries one after the other and finds the mesh and R-tree nodes they
+// touch still in cache.  Within a run, a start in the polygon of the
+// previous one takes its location, and the previous k-th distance plus the
+// distance between the starts bounds its search.  Queries at the same
+// point are searched once.
+class KnnBatch
+{
+    private:
+        MeshPtr mesh;
+        TargetHeuristic* targets;
+        int num_threads;
+        std::vector<TargetHeuristic*> workers;
+        std::atomic<int> next_run;
+        std::atomic<int> located;
+
+        warthog::timer timer;
+
+        void run_worker(int id, int k, unsigned filter, const std::vector<Point>& starts,
+                        const std::vector<int>& order, std::vector<KnnResult>& out);
+
+    public:
+        static const int RUN_SIZE = 16;
+        bool distance_only;
+
+        KnnBatch(MeshPtr m, TargetHeuristic* t, int threads);
+        KnnBatch(KnnBatch const &) = delete;
+        void operator=(KnnBatch const &x) = delete;
+        ~KnnBatch();
+
+        int get_num_threads() { return num_threads; }
+
+        // Answers the k nearest targets of every start (having all bits of
+        // the filter); out[i] is the result of starts[i].
+        void search(const std::vector<Point>& starts, int k, std::vector<KnnResult>& out,
+                    unsigned filter = 0);
+
+        // queries of the last batch in the polygon of the one before them
+        int get_located() { return located.load(); }
+
+        double get_search_micro()
+        {
+            return timer.elapsed_time_micro();
+        }
+};
+
+}
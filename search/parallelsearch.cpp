@@ -0,0 +1,358 @@
+#include "parallelsearch.h"
+#include "expansion.h"
+#include "geometry.h"
+#include "searchnode.h"
+#include "successor.h"
+#include "mesh.h"
+#include "point.h"
+#include "consts.h"
+#include <thread>
+#include <queue>
+#include <vector>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+
+namespace polyanya
+{
+
+void ParallelSearchInstance::init()
+{
+    verbose = false;
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+    final_node = nullptr;
+    for (int i = 0; i < num_threads; i++)
+    {
+        workers.push_back(new SearchInstance(mesh));
+    }
+    inboxes = new Inbox[num_threads];
+    for (int i = 0; i < num_threads; i++)
+    {
+        inboxes[i].head.store(nullptr);
+    }
+}
+
+ParallelSearchInstance::~ParallelSearchInstance()
+{
+    for (int i = 0; i < num_threads; i++)
+    {
+        Message* m = inboxes[i].head.exchange(nullptr);
+        while (m != nullptr)
+        {
+            Message* next = m->next;
+            delete m;
+            m = next;
+        }
+        delete workers[i];
+    }
+    delete[] inboxes;
+}
+
+void ParallelSearchInstance::init_search()
+{
+    final_node = nullptr;
+    best_cost.store(INF);
+    pending.store(num_threads);
+    nodes_generated = 0;
+    nodes_pushed = 0;
+    nodes_popped = 0;
+    nodes_pruned_post_pop = 0;
+    successor_calls = 0;
+    messages = 0;
+
+    // Every worker resets its pool and root tables; only the initial nodes
+    // of the first worker are kept, and handed to their owners.
+    for (SearchInstance* w : workers)
+    {
+        w->set_start_goal(start, goal);
+        w->init_search();
+    }
+    for (int i = 1; i < num_threads; i++)
+    {
+        workers[i]->open_list = SearchInstance::pq();
+    }
+    SearchInstance& first = *workers[0];
+    std::vector<SearchNodePtr> initial;
+    while (!first.open_list.empty())
+    {
+        initial.push_back(first.open_list.top());
+        first.open_list.pop();
+    }
+    for (SearchNodePtr n : initial)
+    {
+        const int to = owner(n->next_polygon);
+        if (to == 0)
+        {
+            first.open_list.push(n);
+        }
+        else
+        {
+            SearchInstance& w = *workers[to];
+            w.open_list.push(new (w.node_pool->allocate()) SearchNode(*n));
+        }
+    }
+}
+
+void ParallelSearchInstance::send(int to, Message* first, Message* last)
+{
+    Message* head = inboxes[to].head.load(std::memory_order_relaxed);
+    do
+    {
+        last->next = head;
+    }
+    while (!inboxes[to].head.compare_exchange_weak(
+                head, first, std::memory_order_release,
+                std::memory_order_relaxed));
+}
+
+void ParallelSearchInstance::found_goal(SearchInstance& w, SearchNodePtr node)
+{
+    const int final_root = [&]()
+    {
+        const Point& root = (node->root == -1 ? start :
+                             mesh->mesh_vertices[node->root].p);
+        const Point root_goal = goal - root;
+        // If root-left-goal is not CW, use left.
+        if (root_goal * (node->left - root) < -EPSILON)
+        {
+            return node->left_vertex;
+        }
+        // If root-right-goal is not CCW, use right.
+        if ((node->right - root) * root_goal < -EPSILON)
+        {
+            return node->right_vertex;
+        }
+        // Use the normal root.
+        return node->root;
+    }();
+
+    std::lock_guard<std::mutex> lock(final_mutex);
+    if (node->f < best_cost.load())
+    {
+        final_node = new (w.node_pool->allocate()) SearchNode
+            {node, final_root, goal, goal, -1, -1, w.end_polygon,
+             node->f, node->g};
+        w.nodes_generated++;
+        best_cost.store(node->f);
+    }
+}
+
+void ParallelSearchInstance::run_worker(int id)
+{
+    SearchInstance& w = *workers[id];
+    std::vector<Message*> out_first(num_threads, nullptr);
+    std::vector<Message*> out_last(num_threads, nullptr);
+    int sent = 0;
+    bool active = true;
+
+    while (true)
+    {
+        Message* m = inboxes[id].head.exchange(nullptr,
+                                               std::memory_order_acquire);
+        if (m != nullptr)
+        {
+            if (!active)
+            {
+                pending.fetch_add(1);
+                active = true;
+            }
+            long received = 0;
+            while (m != nullptr)
+            {
+                Message* next = m->next;
+                if (m->node.f < best_cost.load(std::memory_order_relaxed))
+                {
+                    w.open_list.push(new (w.node_pool->allocate())
+                                     SearchNode(m->node));
+                }
+                delete m;
+                m = next;
+                received++;
+            }
+            pending.fetch_sub(received);
+        }
+
+        if (w.open_list.empty() ||
+            w.open_list.top()->f >= best_cost.load(std::memory_order_relaxed))
+        {
+            // Nothing here can beat the best path any more.
+            if (!w.open_list.empty())
+            {
+                w.open_list = SearchInstance::pq();
+            }
+            if (active)
+            {
+                active = false;
+                pending.fetch_sub(1);
+            }
+            if (pending.load() == 0)
+            {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+
+        SearchNodePtr node = w.open_list.top(); w.open_list.pop();
+        w.nodes_popped++;
+        if (node->next_polygon == w.end_polygon)
+        {
+            found_goal(w, node);
+            continue;
+        }
+
+        const int root = node->root;
+        if (root != -1 && w.root_search_ids[root] == w.search_id &&
+            w.root_g_values[root] + EPSILON < node->g)
+        {
+            w.nodes_pruned_post_pop++;
+            continue;
+        }
+
+        int num_nodes = 1;
+        SearchNode* to_push = w.search_nodes_to_push;
+        to_push[0] = *node;
+        // Intermediate pruning, as in SearchInstance::search.
+        do
+        {
+            SearchNode cur_node = to_push[0];
+            if (cur_node.next_polygon == w.end_polygon)
+            {
+                break;
+            }
+            int num_succ = get_successors(cur_node, start, *mesh,
+                                          w.search_successors);
+            w.successor_calls++;
+            num_nodes = w.succ_to_node(&cur_node, w.search_successors,
+                                       num_succ, to_push);
+            if (num_nodes == 1 && cur_node.g != to_push[0].g)
+            {
+                to_push[0].parent = node;
+                node = new (w.node_pool->allocate()) SearchNode(to_push[0]);
+                w.nodes_generated++;
+            }
+        }
+        while (num_nodes == 1);
+
+        for (int i = 0; i < num_nodes; i++)
+        {
+            SearchNode n = to_push[i];
+            const Point& n_root = (n.root == -1 ? start :
+                                   mesh->mesh_vertices[n.root].p);
+            n.f += get_h_value(n_root, goal, n.left, n.right);
+            n.parent = node;
+            w.nodes_generated++;
+            if (n.f >= best_cost.load(std::memory_order_relaxed))
+            {
+                continue;
+            }
+            const int to = owner(n.next_polygon);
+            if (to == id)
+            {
+                w.open_list.push(new (w.node_pool->allocate()) SearchNode(n));
+                w.nodes_pushed++;
+            }
+            else
+            {
+                Message* msg = new Message {n, out_first[to]};
+                if (out_first[to] == nullptr)
+                {
+                    out_last[to] = msg;
+                }
+                out_first[to] = msg;
+                sent++;
+            }
+        }
+
+        if (sent > 0)
+        {
+            // count the messages before anyone can receive them
+            pending.fetch_add(sent);
+            for (int to = 0; to < num_threads; to++)
+            {
+                if (out_first[to] != nullptr)
+                {
+                    send(to, out_first[to], out_last[to]);
+                    out_first[to] = nullptr;
+                    out_last[to] = nullptr;
+                }
+            }
+            w.nodes_pushed += sent;
+            messages_sent[id] += sent;
+            sent = 0;
+        }
+    }
+}
+
+bool ParallelSearchInstance::search()
+{
+    init_search();
+    timer.start();
+    SearchInstance& first = *workers[0];
+    if (mesh == nullptr || first.end_polygon == -1)
+    {
+        timer.stop();
+        return false;
+    }
+
+    if (first.final_node != nullptr)
+    {
+        final_node = first.final_node;
+        timer.stop();
+        return true;
+    }
+
+    messages_sent.assign(num_threads, 0);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; i++)
+    {
+        threads.emplace_back(&ParallelSearchInstance::run_worker, this, i);
+    }
+    run_worker(0);
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+    timer.stop();
+
+    for (int i = 0; i < num_threads; i++)
+    {
+        const SearchInstance& w = *workers[i];
+        nodes_generated += w.nodes_generated;
+        nodes_pushed += w.nodes_pushed;
+        nodes_popped += w.nodes_popped;
+        nodes_pruned_post_pop += w.nodes_pruned_post_pop;
+        successor_calls += w.successor_calls;
+        messages += messages_sent[i];
+    }
+    return final_node != nullptr;
+}
+
+void ParallelSearchInstance::get_path_points(std::vector<Point>& out)
+{
+    if (final_node == nullptr)
+    {
+        return;
+    }
+    #define root_to_point(root) ((root) == -1 ? start : \
+                                 mesh->mesh_vertices[root].p)
+    out.clear();
+    out.push_back(goal);
+    SearchNodePtr cur_node = final_node;
+
+    while (cur_node != nullptr)
+    {
+        if (root_to_point(cur_node->root) != out.back())
+        {
+            out.push_back(root_to_point(cur_node->root));
+        }
+        cur_node = cur_node->parent;
+    }
+    std::reverse(out.begin(), out.end());
+    #undef root_to_point
+}
+
+}
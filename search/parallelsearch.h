@@ -0,0 +1,110 @@
+#pragma once
+#include "searchinstance.h"
+#include "searchnode.h"
+#include "mesh.h"
+#include "point.h"
+#include "timer.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace polyanya
+{
+
+// Hash-distributed parallel Polyanya (HDA*) for point to point search.
+//
+// Every worker owns the search nodes whose next_polygon hashes to it, and
+// keeps its own open list, node pool and root pruning tables (a
+// SearchInstance without gen_initial_nodes).  Successors owned by another
+// worker are sent through a lock-free multi-producer inbox.  Workers keep
+// expanding while they hold nodes with f below the best path found so far;
+// the search ends when no worker is active and no message is in flight.
+class ParallelSearchInstance
+{
+    // a search node in flight to its owner
+    struct Message
+    {
+        SearchNode node;
+        Message* next;
+    };
+
+    // Treiber stack; the owner takes the whole list at once, so there is
+    // no ABA problem on pop.  Padded to a cache line so the heads of an
+    // array of them never share one (new[] ignores alignas before C++17).
+    struct Inbox
+    {
+        std::atomic<Message*> head;
+        char pad[64 - sizeof(std::atomic<Message*>)];
+    };
+
+    private:
+        MeshPtr mesh;
+        Point start, goal;
+        int num_threads;
+        std::vector<SearchInstance*> workers;
+        Inbox* inboxes;
+
+        // active workers + messages sent but not yet received
+        std::atomic<long> pending;
+        std::atomic<double> best_cost;
+        std::mutex final_mutex;
+        SearchNodePtr final_node;
+        std::vector<int> messages_sent;  // per worker, summed after search
+
+        warthog::timer timer;
+
+        void init();
+        int owner(int poly) const
+        {
+            const unsigned h = (unsigned) poly * 2654435761u;
+            return (int) (((unsigned long long) h * num_threads) >> 32);
+        }
+        void init_search();
+        void run_worker(int id);
+        void send(int to, Message* first, Message* last);
+        void found_goal(SearchInstance& w, SearchNodePtr node);
+
+    public:
+        int nodes_generated;        // Nodes stored in memory
+        int nodes_pushed;           // Nodes pushed onto open
+        int nodes_popped;           // Nodes popped off open
+        int nodes_pruned_post_pop;  // Nodes we prune right after popping off
+        int successor_calls;        // Times we call get_successors
+        int messages;               // Nodes sent to another worker
+        bool verbose;
+
+        ParallelSearchInstance(MeshPtr m, int threads) :
+            mesh(m), num_threads(threads) { init(); }
+        ParallelSearchInstance(ParallelSearchInstance const &) = delete;
+        void operator=(ParallelSearchInstance const &x) = delete;
+        ~ParallelSearchInstance();
+
+        void set_start_goal(Point s, Point g)
+        {
+            start = s;
+            goal = g;
+            final_node = nullptr;
+        }
+
+        int get_num_threads() { return num_threads; }
+
+        bool search();
+        double get_cost()
+        {
+            if (final_node == nullptr)
+            {
+                return -1;
+            }
+
+            return final_node->f;
+        }
+
+        double get_search_micro()
+        {
+            return timer.elapsed_time_micro();
+        }
+
+        void get_path_points(std::vector<Point>& out);
+};
+
+}
@@ -338,10 +338,11 @@ bool SearchInstance::search()
 
             const SearchNodePtr true_final =
                 new (node_pool->allocate()) SearchNode
-                {node, final_root, goal, goal, -1, -1, end_polygon,
-                 node->f, node->g};
+                {distance_only ? nullptr : node, final_root, goal, goal,
+                 -1, -1, end_polygon, node->f, node->g};
 
             nodes_generated++;
+            free_node(node);
 
             timer.stop();
 
@@ -376,12 +377,15 @@ bool SearchInstance::search()
                     #endif
 
                     // We've done better!
+                    free_node(node);
                     continue;
                 }
             }
         }
         int num_nodes = 1;
         search_nodes_to_push[0] = *node;
+        const SearchNodePtr popped = node;
+        SearchNode turned;
 
         // We use a do while here because the first iteration is guaranteed
         // to work.
@@ -405,9 +409,18 @@ bool SearchInstance::search()
                 {
                     // Turned. Set the parent of this, and set the current
                     // node pointer to this after allocating space for it.
-                    search_nodes_to_push[0].parent = node;
-                    node = new (node_pool->allocate())
-                        SearchNode(search_nodes_to_push[0]);
+                    // Without paths nothing refers to it, so a copy will do.
+                    if (distance_only)
+                    {
+                        turned = search_nodes_to_push[0];
+                        node = &turned;
+                    }
+                    else
+                    {
+                        search_nodes_to_push[0].parent = node;
+                        node = new (node_pool->allocate())
+                            SearchNode(search_nodes_to_push[0]);
+                    }
                     nodes_generated++;
                 }
 
@@ -433,7 +446,7 @@ bool SearchInstance::search()
             n->f += get_h_value(n_root, goal, n->left, n->right);
 
             // This node's parent should be nullptr, so we should set it.
-            n->parent = node;
+            n->parent = distance_only ? nullptr : node;
 
             #ifndef NDEBUG
             if (verbose)
@@ -448,6 +461,7 @@ bool SearchInstance::search()
         }
         nodes_generated += num_nodes;
         nodes_pushed += num_nodes;
+        free_node(popped);
     }
 
     timer.stop();
@@ -29,6 +29,8 @@ typedef Mesh* MeshPtr;
 // Polyanya instance for point to point search
 class SearchInstance
 {
+    // runs a SearchInstance per worker thread
+    friend class ParallelSearchInstance;
     typedef std::priority_queue<SearchNodePtr, std::vector<SearchNodePtr>,
                                 PointerComp<SearchNode> > pq;
     private:
@@ -38,6 +40,8 @@ class SearchInstance
 
         SearchNodePtr final_node;
         int end_polygon; // set by init_search
+        // Only keep distances: no parent links, popped nodes are recycled.
+        bool distance_only = false;
         pq open_list;
 
         // Best g value for a specific vertex.
@@ -92,6 +96,13 @@ class SearchInstance
             int num_succ, SearchNode* nodes
         );
         void print_node(SearchNodePtr node, std::ostream& outfile);
+        void free_node(SearchNodePtr node)
+        {
+            if (distance_only)
+            {
+                node_pool->deallocate((char*) node);
+            }
+        }
 
     public:
         int nodes_generated;        // Nodes stored in memory
@@ -125,6 +136,19 @@ class SearchInstance
             final_node = nullptr;
         }
 
+        void set_distance_only(bool flag)
+        {
+            distance_only = flag;
+        }
+
+        MeshPtr get_mesh() { return mesh; }
+
+        // Most search nodes held in memory at once during the last search.
+        size_t get_peak_live()
+        {
+            return node_pool->peak_live();
+        }
+
         bool search();
         double get_cost()
         {
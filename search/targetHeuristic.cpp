@@ -32,7 +32,7 @@ int TargetHeuristic::succ_to_node(
     const int next_polygon = P[succ.poly_left_ind];
     if (next_polygon == -1) continue;
     // no end_polygon in knn
-    if (mesh->mesh_polygons[next_polygon].is_one_way && end_polygons[next_polygon].empty()) continue;
+    if (mesh->mesh_polygons[next_polygon].is_one_way && targets->end_polygons[next_polygon].empty()) continue;
     const int left_vertex = V[succ.poly_left_ind];
     const int right_vertex = succ.poly_left_ind? V[succ.poly_left_ind - 1]: V.back();
 
@@ -82,14 +82,146 @@ int TargetHeuristic::succ_to_node(
 }
 
 void TargetHeuristic::set_end_polygon() {
-  end_polygons.resize(mesh->mesh_polygons.size());
-  for (int i=0; i<(int)mesh->mesh_polygons.size(); i++) end_polygons[i].clear();
-  for (int i=0; i<(int)goals.size(); i++) {
-    int poly_id = get_point_location_in_search(goals[i], mesh, verbose).poly1;
+  own.end_polygons.resize(mesh->mesh_polygons.size());
+  for (int i=0; i<(int)mesh->mesh_polygons.size(); i++) own.end_polygons[i].clear();
+  own.goal_poly.assign(own.goals.size(), -1);
+  for (int i=0; i<(int)own.goals.size(); i++) {
+    if (!own.alive[i]) continue;
+    int poly_id = get_point_location_in_search(own.goals[i], mesh, verbose).poly1;
     if (poly_id == -1) continue;
-    assert(poly_id < (int)end_polygons.size());
-    end_polygons[poly_id].push_back(i);
+    assert(poly_id < (int)own.end_polygons.size());
+    own.end_polygons[poly_id].push_back(i);
+    own.goal_poly[i] = poly_id;
   }
+  own.end_index.build(own.end_polygons, own.goals);
+}
+
+void TargetHeuristic::set_goal_polygon(int gid, int poly) {
+  const int old = own.goal_poly[gid];
+  if (old == poly) return;
+  if (old != -1) {
+    std::vector<int>& gs = own.end_polygons[old];
+    gs.erase(std::find(gs.begin(), gs.end(), gid));
+    own.end_index.update(old, own.end_polygons, own.goals);
+  }
+  own.goal_poly[gid] = poly;
+  if (poly != -1) {
+    own.end_polygons[poly].push_back(gid);
+    own.end_index.update(poly, own.end_polygons, own.goals);
+  }
+}
+
+int TargetHeuristic::add_target(const Point& g, unsigned attrs) {
+  assert(targets == &own);
+  // loaded or shared targets have no rte yet
+  if (rte == nullptr) initRtree();
+  targets_version++;
+  int gid;
+  if (free_gids.empty()) {
+    gid = (int)own.goals.size();
+    own.goals.push_back(g);
+    own.goal_attrs.push_back(attrs);
+    own.alive.push_back(0);
+    own.goal_poly.push_back(-1);
+    gids.push_back(gid);
+    rtEntries.push_back(rs::LeafNodeEntry(rs::Mbr(), (rs::Data_P)(&gids.back())));
+  } else {
+    gid = free_gids.back();
+    free_gids.pop_back();
+    own.goals[gid] = g;
+    own.goal_attrs[gid] = attrs;
+  }
+  own.alive[gid] = 1;
+  own.num_targets++;
+
+  rtEntries[gid].mbre = rs::Mbr(g.x, g.x, g.y, g.y);
+  rte->insertData(&rtEntries[gid]);
+  own.pending.push_back(gid);
+  if (++srt_updates > PENDING_MAX) rebuild_static();
+
+  set_goal_polygon(gid, get_point_location_in_search(own.goals[gid], mesh, verbose).poly1);
+  return gid;
+}
+
+void TargetHeuristic::remove_target(int gid) {
+  assert(targets == &own);
+  assert(gid >= 0 && gid < (int)own.goals.size() && own.alive[gid]);
+  if (rte == nullptr) initRtree();
+  targets_version++;
+  rte->deleteData(&rtEntries[gid]);
+  // removed from srt in place, its box stays until the next rebuild
+  if (!own.srt.remove(gid))
+    own.pending.erase(std::find(own.pending.begin(), own.pending.end(), gid));
+  if (++srt_updates > PENDING_MAX) rebuild_static();
+
+  set_goal_polygon(gid, -1);
+  own.alive[gid] = 0;
+  own.num_targets--;
+  free_gids.push_back(gid);
+}
+
+void TargetHeuristic::move_target(int gid, const Point& g) {
+  const unsigned attrs = own.goal_attrs[gid];
+  remove_target(gid);
+  // the gid just freed is the first to be reused
+  const int same = add_target(g, attrs);
+  assert(same == gid);
+  (void)same;
+}
+
+bool TargetHeuristic::save_targets(const std::string& path) {
+  // pending targets are packed first
+  if (!own.pending.empty()) rebuild_static();
+  TargetIndex index;
+  index.goals = own.goals;
+  index.goal_poly = own.goal_poly;
+  index.attrs = own.goal_attrs;
+  index.alive = own.alive;
+  index.tree = own.srt;
+  return save_target_index(path, mesh->get_hash(), index);
+}
+
+bool TargetHeuristic::load_targets(const std::string& path) {
+  TargetIndex index;
+  if (!load_target_index(path, mesh->get_hash(), mesh->mesh_polygons.size(), index)) return false;
+  targets = &own;
+  own.goals = std::move(index.goals);
+  own.goal_poly = std::move(index.goal_poly);
+  own.goal_attrs = std::move(index.attrs);
+  own.alive = std::move(index.alive);
+  own.srt = std::move(index.tree);
+  // a snapshot written without attributes has no masks
+  if (own.srt.mask.size() != own.srt.child.size()) own.srt.setMasks(own.goal_attrs);
+  own.pending.clear();
+  srt_updates = 0;
+  free_gids.clear();
+  own.num_targets = 0;
+  for (int i=(int)own.goals.size()-1; i>=0; i--) {
+    if (own.alive[i]) own.num_targets++;
+    else free_gids.push_back(i);
+  }
+  // the pointer tree is only needed for updates, it is built by the first one
+  if (rte != nullptr) delete rte;
+  rte = nullptr;
+  rtEntries.clear();
+  gids.clear();
+
+  // end_polygons from the stored polygons, nothing is located
+  own.end_polygons.assign(mesh->mesh_polygons.size(), std::vector<int>());
+  for (int i=0; i<(int)own.goals.size(); i++)
+    if (own.alive[i] && own.goal_poly[i] != -1) own.end_polygons[own.goal_poly[i]].push_back(i);
+  own.end_index.build(own.end_polygons, own.goals);
+  targets_version++;
+  return true;
+}
+
+void TargetHeuristic::set_target_attributes(int gid, unsigned attrs) {
+  assert(targets == &own);
+  assert(gid >= 0 && gid < (int)own.goals.size() && own.alive[gid]);
+  targets_version++;
+  own.goal_attrs[gid] = attrs;
+  // pending targets are not in srt yet
+  own.srt.setMask(gid, attrs);
 }
 
 void TargetHeuristic::push_lazy(SearchNodePtr lazy) {
@@ -99,11 +231,13 @@ void TargetHeuristic::push_lazy(SearchNodePtr lazy) {
   const int poly = lazy->next_polygon;
   if (poly == -1) return;
 
-  if (!end_polygons[poly].empty()) {
-    for (int gid: end_polygons[poly]) {
-      const Point& goal = goals[gid];
+  if (!targets->end_polygons[poly].empty()) {
+    for (int gid: targets->end_polygons[poly]) {
+      if (!matches(gid)) continue;
+      const Point& goal = targets->goals[gid];
       SearchNodePtr final_node = get_lazy(lazy->next_polygon, lazy->left_vertex, lazy->right_vertex);
       final_node->f += start.distance(goal);
+      kth_bound.add(gid, final_node->f);
       final_node->set_reached();
       final_node->set_goal_id(gid);
 
@@ -155,12 +289,16 @@ void TargetHeuristic::push_lazy(SearchNodePtr lazy) {
     }
     #endif
     assert(nxt->heuristic_gid != -1);
-    open_list.push(nxt);
-    nodes_pushed++;
-
-    if (!end_polygons[nxt->next_polygon].empty()) {
+    if (!targets->end_polygons[nxt->next_polygon].empty()) {
       gen_final_nodes(nxt, nxt_root);
     }
+    // no target through nxt is within the bound of the k-th
+    if (nxt->f > start_bound + EPSILON) {
+      free_node(nxt);
+      continue;
+    }
+    open_list.push(nxt);
+    nodes_pushed++;
   }
   delete[] nodes;
   delete[] successors;
@@ -175,7 +313,7 @@ void TargetHeuristic::gen_initial_nodes() {
   // modify:
   // 1. h value for get_lazy() is 0
   // 2. no end_polygon in knn search
-  const PointLocation pl = get_point_location_in_search(start, mesh, verbose);
+  const PointLocation pl = start_located? start_loc: get_point_location_in_search(start, mesh, verbose);
   #define get_lazy(next, left, right) new (node_pool->allocate()) SearchNode \
     {nullptr, -1, start, start, left, right, next, 0, 0}
   #define v(vertex) mesh->mesh_vertices[vertex]
@@ -230,7 +368,8 @@ void TargetHeuristic::gen_initial_nodes() {
 
 #define root_to_point(root) ((root) == -1 ? start : mesh->mesh_vertices[root].p)
 
-int TargetHeuristic::search() {
+int TargetHeuristic::search(unsigned filter) {
+  this->filter = filter;
   init_search();
   timer.start();
   if (mesh == nullptr) {
@@ -252,6 +391,7 @@ int TargetHeuristic::search() {
     nodes_popped++;
     if (node->reached) {
       deal_final_node(node);
+      free_node(node);
       if ((int)final_nodes.size() == K) break;
       continue;
     }
@@ -267,7 +407,7 @@ int TargetHeuristic::search() {
       node->f = nexth.second + node->g;
       nodes_reevaluate++;
       if (node->heuristic_gid == -1) {
-        assert((int)final_nodes.size() == std::min(K, (int)goals.size()));
+        assert((int)final_nodes.size() == std::min(K, num_matching));
         break;
       };
       #ifndef NDEBUG
@@ -294,12 +434,15 @@ int TargetHeuristic::search() {
           #ifndef NDEBUG
           if (verbose) std::cerr << "node is dominated!" << std::endl;
           #endif
+          free_node(node);
           continue;
         }
       }
     }
     int num_nodes = 1;
     search_nodes_to_push[0] = *node;
+    const SearchNodePtr popped = node;
+    SearchNode turned;
     // Intermediate pruning
     do {
       SearchNode cur = search_nodes_to_push[0];
@@ -312,15 +455,21 @@ int TargetHeuristic::search() {
         if (cur.g != search_nodes_to_push[0].g) {
           // Turned. Set the parent of this, and set the current
           // node pointer to this after allocating space for it.
-          search_nodes_to_push[0].parent = node;
-          node = new (node_pool->allocate()) SearchNode(search_nodes_to_push[0]);
+          // Without paths nothing refers to it, so a copy will do.
+          if (distance_only) {
+            turned = search_nodes_to_push[0];
+            node = &turned;
+          } else {
+            search_nodes_to_push[0].parent = node;
+            node = new (node_pool->allocate()) SearchNode(search_nodes_to_push[0]);
+          }
           nodes_generated++;
         }
-        if (!end_polygons[search_nodes_to_push[0].next_polygon].empty()) {
-          const SearchNodePtr nxt = new (node_pool->allocate()) SearchNode(search_nodes_to_push[0]);
-          nxt->parent = node;
-          const Point& nxt_root = nxt->root == -1? start: mesh->mesh_vertices[nxt->root].p;
-          gen_final_nodes(nxt, nxt_root);
+        if (!targets->end_polygons[search_nodes_to_push[0].next_polygon].empty()) {
+          SearchNode nxt = search_nodes_to_push[0];
+          nxt.parent = distance_only? nullptr: node;
+          const Point& nxt_root = nxt.root == -1? start: mesh->mesh_vertices[nxt.root].p;
+          gen_final_nodes(&nxt, nxt_root);
         }
         #ifndef NDEBUG
         if (verbose) {
@@ -341,7 +490,7 @@ int TargetHeuristic::search() {
       assert(node->heuristic_gid != -1);
       double geth;
       if (isVisited) geth = INF;
-      else geth = get_h_value(nxt_root, goals[node->heuristic_gid], nxt->left, nxt->right);
+      else geth = get_h_value(nxt_root, targets->goals[node->heuristic_gid], nxt->left, nxt->right);
       if (fabs(geth - (node->f - nxt->g)) <= EPSILON) { // heuristic not change
         nxt->heuristic_gid = node->heuristic_gid;
         nxt->f = node->f;
@@ -353,7 +502,17 @@ int TargetHeuristic::search() {
         nxt->heuristic_gid = nxth.first;
         nxt->f = nxt->g + nxth.second;
       }
-      nxt->parent = node;
+      nxt->parent = distance_only? nullptr: node;
+      // when nxt can be final_node
+      int nxt_poly = nxt->next_polygon;
+      if (!targets->end_polygons[nxt_poly].empty()) {
+        gen_final_nodes(nxt, nxt_root);
+      }
+      // no target through nxt is within the bound of the k-th
+      if (nxt->f > start_bound + EPSILON) {
+        free_node(nxt);
+        continue;
+      }
       #ifndef NDEBUG
       if (verbose) {
         std::cerr << "\tpushing: ";
@@ -364,13 +523,8 @@ int TargetHeuristic::search() {
       open_list.push(nxt);
       nodes_pushed++;
       nodes_generated++;
-
-      // when nxt can be final_node
-      int nxt_poly = nxt->next_polygon;
-      if (!end_polygons[nxt_poly].empty()) {
-        gen_final_nodes(nxt, nxt_root);
-      }
     }
+    free_node(popped);
   }
   timer.stop();
   return (int)final_nodes.size();
@@ -381,16 +535,16 @@ void TargetHeuristic::print_node(SearchNodePtr node, std::ostream& outfile) {
           << "; right=" << node->right << "; f=" << node->f << ", g="
           << node->g;// << "; heuristic_gid=" << node->heuristic_gid;
   //if (node->heuristic_gid != -1)
-  //  outfile << "(" << this->goals[node->heuristic_gid].x << "," << this->goals[node->heuristic_gid].y << ")";
+  //  outfile << "(" << targets->goals[node->heuristic_gid].x << "," << targets->goals[node->heuristic_gid].y << ")";
 }
 
 void TargetHeuristic::get_path_points(std::vector<Point>& out, int k) {
-  if (k >= (int)goals.size()) return;
+  if (k >= (int)targets->goals.size()) return;
   assert((int)final_nodes.size() <= K);
   assert(final_nodes[k]->goal_id != -1);
   assert(final_nodes[k]->reached == true);
   out.clear();
-  out.push_back(goals[final_nodes[k]->goal_id]);
+  out.push_back(targets->goals[final_nodes[k]->goal_id]);
   SearchNodePtr cur = final_nodes[k];
 
   while (cur != nullptr) {
@@ -414,7 +568,7 @@ void TargetHeuristic::print_search_nodes(std::ostream& outfile, int k) {
 
 void TargetHeuristic::deal_final_node(const SearchNodePtr node) {
 
-  const Point& goal = goals[node->goal_id];
+  const Point& goal = targets->goals[node->goal_id];
   const int final_root = [&]() {
       const Point& root = root_to_point(node->root);
       const Point root_goal = goal - root;
@@ -439,10 +593,11 @@ void TargetHeuristic::deal_final_node(const SearchNodePtr node) {
     int end_polygon = node->next_polygon;
     const SearchNodePtr true_final =
       new (node_pool->allocate()) SearchNode
-      {node, final_root, goal, goal, -1, -1, end_polygon, node->f, node->g};
+      {distance_only? nullptr: node, final_root, goal, goal, -1, -1, end_polygon, node->f, node->g};
     true_final->set_reached();
     true_final->set_goal_id(node->goal_id);
     reached[node->goal_id] = node->f;
+    unreached.remove(node->goal_id);
     final_nodes.push_back(true_final);
     nodes_generated++;
 
@@ -461,12 +616,18 @@ void TargetHeuristic::deal_final_node(const SearchNodePtr node) {
 }
 
 void TargetHeuristic::gen_final_nodes(const SearchNodePtr node, const Point& rootPoint) {
-    for (int gid: end_polygons[node->next_polygon]) {
-      const Point& goal = goals[gid];
+    // Goals are visited nearest first and only generated while
+    // g + |root, goal| can still beat the k-th best path found so far.
+    const auto visit = [&](int gid) {
+      const Point& goal = targets->goals[gid];
+      if (fabs(reached[gid] - INF) > EPSILON || !matches(gid) ||
+          node->g + rootPoint.distance(goal) > get_bound())
+        return get_bound() - node->g;
       SearchNodePtr final_node = new (node_pool->allocate()) SearchNode(*node);
       final_node->set_reached();
       final_node->set_goal_id(gid);
       final_node->f = final_node->g + get_h_value(rootPoint, goal, node->left, node->right);
+      kth_bound.add(gid, final_node->f);
       #ifndef NDEBUG
       if (verbose) {
         std::cerr << "\tpushing: ";
@@ -477,7 +638,9 @@ void TargetHeuristic::gen_final_nodes(const SearchNodePtr node, const Point& roo
       open_list.push(final_node);
       nodes_generated++;
       nodes_pushed++;
-    }
+      return get_bound() - node->g;
+    };
+    targets->end_index.scan(node->next_polygon, rootPoint, get_bound() - node->g, visit);
 }
 
 /*
@@ -493,164 +656,106 @@ void TargetHeuristic::gen_final_nodes(const SearchNodePtr node, const Point& roo
  * C': nearest neighbour of point p'
  */
 
-rs::MinHeapEntry TargetHeuristic::NearestInAreaAB(double angle0, double angle1, const Point& a, double curMin) {
-
-  double angleDiff = angle1 - angle0;
-  if (angleDiff <= -EPSILON)
-    angleDiff += 360.0;
-
-  auto isInArea = [&](const Point& v0, const Point& v1) {
-    Point vec0 = v0 - a;
-    Point vec1 = v1 - a;
-
-    auto begint = std::chrono::steady_clock::now();
-    double angleV0 = get_angle(vec0, true) - angle0;
-    double angleV1 = get_angle(vec1, true) - angle0;
-    auto endt = std::chrono::steady_clock::now();
-    angle_using += std::chrono::duration_cast<std::chrono::microseconds>(endt - begint).count();
-
-    if (angleV1 < angleV0 - EPSILON)
-      angleV0 -= 360.0;
-    if (angleV1 < -EPSILON || angleV0 > angleDiff + EPSILON) {
-      if (angleV1 + 360 < -EPSILON || angleV0 + 360 > angleDiff + EPSILON)
-        return false;
-      return true;
-    }
+// The box meets the wedge at apex a from direction u0 counterclockwise to u1
+// iff a corner is inside the wedge or one of the two boundary rays hits it.
+static bool wedge_meets_box(const Point& a, const Point& u0, const Point& u1,
+                            const rs::StaticRTree& srt, int slot) {
+  const double x0 = srt.xmin[slot], x1 = srt.xmax[slot];
+  const double y0 = srt.ymin[slot], y1 = srt.ymax[slot];
+  if (in_wedge(Point{x0, y0} - a, u0, u1) || in_wedge(Point{x1, y0} - a, u0, u1) ||
+      in_wedge(Point{x1, y1} - a, u0, u1) || in_wedge(Point{x0, y1} - a, u0, u1))
     return true;
-  };
+  return ray_hits_box(a, u0, x0, x1, y0, y1) || ray_hits_box(a, u1, x0, x1, y0, y1);
+}
 
-  auto isMbrInArea = [&](const rs::Mbr mbr) {
-    std::vector<Point> ps({
-        {mbr.coord[0][0], mbr.coord[1][0]},
-        {mbr.coord[0][1], mbr.coord[1][0]},
-        {mbr.coord[0][1], mbr.coord[1][1]},
-        {mbr.coord[0][0], mbr.coord[1][1]}
-    });
-    for (int i=0; i<4; i++) {
-      const Point& v0 = ps[i];
-      const Point& v1 = ps[(i+1)%4];
-      if (isInArea(v0, v1))
-        return true;
-    }
-    return false;
+void TargetHeuristic::NearestInAreas(const Area* areas, double& minV, int& minArg) {
+  if (!unreached.remaining)
+    return;
+  const rs::StaticRTree& srt = targets->srt;
+
+  auto isSlotInArea = [&](const Area& area, int slot, bool isPoint) {
+    const double x0 = srt.xmin[slot], x1 = srt.xmax[slot];
+    const double y0 = srt.ymin[slot], y1 = srt.ymax[slot];
+    // targets on the same side of lr as p are not in the area
+    auto beyondLR = [&](double x, double y) {
+      return get_orientation(Point{x, y}, area.l, area.r) != Orientation::CW;
+    };
+    if (isPoint)
+      return (!area.beyond || beyondLR(x0, y0)) && in_wedge(Point{x0, y0} - area.apex, area.u0, area.u1);
+    if (area.beyond && !beyondLR(x0, y0) && !beyondLR(x1, y0) && !beyondLR(x1, y1) && !beyondLR(x0, y1))
+      return false;
+    return wedge_meets_box(area.apex, area.u0, area.u1, srt, slot);
   };
 
-  rs::MinHeap heap;
-  rs::Point P(a.x, a.y);
-  double initD = sqrt(rs::RStarTreeUtil::minDis2(P, rte->root->mbrn));
-  heap.push(rs::MinHeapEntry(initD, rte->root));
-  rs::MinHeapEntry res(INF, rte->root);
+  rs::Point P[AREA_NUM];
+  for (int k=0; k<AREA_NUM; k++)
+    P[k] = rs::Point(areas[k].apex.x, areas[k].apex.y);
+  const int M = srt.maxSize;
+  heap.clear();
+  heap.dis.resize(AREA_NUM * M);
+  // node entries are tagged with the mask of the areas they may meet,
+  // children are only tested against those
+  heap.push(rs::StaticHeapEntry(0, 0, (1 << AREA_NUM) - 1));
+  // shared threshold: the best value of any target pushed so far
+  double bound = minV;
   while (!heap.isEmpty()) {
-    rs::MinHeapEntry c = heap.pop();
-    if (c.nodePtr) { // it's interior node
-      if (c.nodePtr->level) {
-        for (const auto& it: *c.nodePtr->children) if (isMbrInArea(it->mbrn)) {
-          double d = sqrt(rs::RStarTreeUtil::minDis2(P, it->mbrn));
-          if (d <= curMin + EPSILON)
-            heap.push(rs::MinHeapEntry(d, it));
-        }
-      }
-      else {
-        for (const auto& it: *c.nodePtr->entries) {
-          int gid = *((int*)(it->data));
-          //if (reached.find(gid) != reached.end())
-          if (fabs(reached[gid] - INF) > EPSILON)
-            continue;
-          if (isMbrInArea(it->mbre)) {
-            double d = sqrt(rs::RStarTreeUtil::minDis2(P, it->mbre));
-            if (d <= curMin + EPSILON)
-              heap.push(rs::MinHeapEntry(d, it));
-          }
-        }
+    rs::StaticHeapEntry c = heap.pop();
+    if (c.key > bound + EPSILON)
+      break;
+    if (c.node == -1) { // it's leaf node
+      if (c.key < minV) {
+        minV = c.key;
+        minArg = c.id;
       }
-    }
-    else { // it's leaf node
-      res = c;
       break;
     }
-  }
-  while (!heap.isEmpty()) heap.pop();
-  return res;
-}
-
-rs::MinHeapEntry TargetHeuristic::NearestInAreaC(double angle0, double angle1, const Point& p, const Point& l, const Point& r, double curMin) {
-
-  double angleDiff = angle1 - angle0;
-  if (angleDiff <= -EPSILON)
-    angleDiff += 360.0;
-
-  auto isInArea = [&](const Point& v0, const Point& v1) {
-    if (v0.distance(v1) <= EPSILON) {
-      Orientation o = get_orientation(v0, l, r);
-      if (o == Orientation::CW)
-        return false;
-    }
-    Point vec0 = v0 - p;
-    Point vec1 = v1 - p;
-    double angleV0 = get_angle(vec0) - angle0;
-    double angleV1 = get_angle(vec1) - angle0;
-    if (angleV1 < angleV0 - EPSILON)
-      angleV0 -= 360.0;
-    if (angleV1 < - EPSILON || angleV0 > angleDiff + EPSILON) {
-      if (angleV1 + 360 < -EPSILON || angleV0 + 360 > angleDiff + EPSILON)
-        return false;
-      return true;
-    }
-    else return true;
-  };
-
-  auto isMbrInArea = [&](const rs::Mbr mbr) {
-    std::vector<Point> ps({
-        {mbr.coord[0][0], mbr.coord[1][0]},
-        {mbr.coord[0][1], mbr.coord[1][0]},
-        {mbr.coord[0][1], mbr.coord[1][1]},
-        {mbr.coord[0][0], mbr.coord[1][1]}
-    });
-    for (int i=0; i<4; i++) {
-      const Point& v0 = ps[i];
-      const Point& v1 = ps[(i+1)%4];
-      if (isInArea(v0, v1))
-        return true;
-    }
-    return false;
-  };
-
-  rs::MinHeap heap;
-  rs::Point P(p.x, p.y);
-  double initD = sqrt(rs::RStarTreeUtil::minDis2(P, rte->root->mbrn));
-  heap.push(rs::MinHeapEntry(initD, rte->root));
-  rs::MinHeapEntry res(INF, rte->root);
-  while (!heap.isEmpty()) {
-    rs::MinHeapEntry c = heap.pop();
-    if (c.nodePtr) { // it's interior node
-      if (c.nodePtr->level) {
-        for (const auto& it: *c.nodePtr->children) if (isMbrInArea(it->mbrn)) {
-          double d = sqrt(rs::RStarTreeUtil::minDis2(P, it->mbrn));
-          if (d <= curMin + EPSILON)
-            heap.push(rs::MinHeapEntry(d, it));
-        }
+    // it's interior node
+    const rs::StaticNode& node = srt.nodes[c.node];
+    for (int k=0; k<AREA_NUM; k++) if (c.id >> k & 1)
+      srt.minDis2(P[k], node, &heap.dis[k * M]);
+    for (int i=0; i<node.size; i++) {
+      const int slot = node.first + i;
+      // nothing left to reach below
+      if (!unreached.get(slot))
+        continue;
+      // no goal below has the bits of the filter
+      if (filter && !srt.matches(slot, filter))
+        continue;
+      // areas within the bound, by increasing lower bound
+      int cand[AREA_NUM], num = 0;
+      double lb[AREA_NUM];
+      for (int k=0; k<AREA_NUM; k++) if (c.id >> k & 1) {
+        // squared distances are compared before taking any sqrt
+        const double budget = bound + EPSILON - areas[k].offset;
+        const double d2 = heap.dis[k * M + i];
+        if (budget < 0 || d2 > budget * budget)
+          continue;
+        lb[k] = areas[k].offset + sqrt(d2);
+        int j = num++;
+        for (; j > 0 && lb[cand[j-1]] > lb[k]; j--) cand[j] = cand[j-1];
+        cand[j] = k;
       }
-      else {
-        for (const auto& it: *c.nodePtr->entries) {
-          int gid = *((int*)(it->data));
-          //if (reached.find(gid) != reached.end())
-          if (fabs(reached[gid] - INF) > EPSILON)
-            continue;
-          if (isMbrInArea(it->mbre)) {
-            double d = sqrt(rs::RStarTreeUtil::minDis2(P, it->mbre));
-            if (d <= curMin + EPSILON)
-              heap.push(rs::MinHeapEntry(d, it));
-          }
+      // The key is the lower bound of the first area that really meets the
+      // slot; the areas after it stay in the mask without being tested,
+      // a superset of the areas met is enough for the children.
+      double best = INF;
+      int mask = 0;
+      for (int j=0; j<num; j++) {
+        if (mask) {
+          mask |= 1 << cand[j];
+        }
+        else if (isSlotInArea(areas[cand[j]], slot, !node.level)) {
+          best = lb[cand[j]];
+          mask |= 1 << cand[j];
         }
       }
-    }
-    else { // it's leaf node
-      res = c;
-      break;
+      if (!mask)
+        continue;
+      if (!node.level)
+        bound = std::min(bound, best);
+      heap.push(rs::StaticHeapEntry(best, node.level? srt.child[slot]: -1, node.level? mask: srt.child[slot]));
     }
   }
-  while (!heap.isEmpty()) heap.pop();
-  return res;
 }
 
 #undef root_to_point
@@ -6,12 +6,16 @@
 #include "successor.h"
 #include "mesh.h"
 #include "point.h"
+#include "endpolygons.h"
 #include "cpool.h"
 #include "timer.h"
 #include "RStarTree.h"
 #include "RStarTreeUtil.h"
+#include "StaticRTree.h"
+#include "targetindex.h"
 #include "knnMeshFence.h"
 #include <chrono>
+#include <deque>
 #include <queue>
 #include <vector>
 #include <ctime>
@@ -20,22 +24,70 @@ namespace polyanya {
 
 namespace rs = rstar;
 
+// The targets a search reads: the goals, the polygons they lie in and the
+// flat R-tree over them.  Only the instance holding them changes them.
+struct TargetSet {
+  std::vector<Point> goals;
+  // Dynamic targets: removed gids are recycled, the polygon of each
+  // live goal is kept so it can leave end_polygons again.
+  std::vector<char> alive;
+  std::vector<int> goal_poly;
+  int num_targets = 0;
+  // Attribute bits of each goal.
+  std::vector<unsigned> goal_attrs;
+  // poly_id: goal1, goal2, ...
+  std::vector<std::vector<int>> end_polygons;
+  // sub-index of end_polygons
+  EndPolygonIndex end_index;
+  // flat copy of rte used by the heuristic queries
+  rs::StaticRTree srt;
+  // Targets added since srt was built are checked one by one by the
+  // heuristic.
+  std::vector<int> pending;
+};
+
+class KnnBatch;
+
 class TargetHeuristic {
+    friend class KnnBatch;
     typedef std::priority_queue<SearchNodePtr, std::vector<SearchNodePtr>,
                                 PointerComp<SearchNode> > pq;
     private:
         int K = 1;
+        // Only keep distances: no parent links, popped nodes are recycled.
+        bool distance_only = false;
         bool reassign = true;
         warthog::mem::cpool* node_pool;
         MeshPtr mesh;
         Point start;
-        std::vector<Point> goals;
+        // where start is, if given with it
+        PointLocation start_loc;
+        bool start_located = false;
+        // upper bound of the k-th distance, if given with the start
+        double start_bound = INF;
         KnnMeshEdgeFence* meshFence;
 
         // kNN has k final node
         std::vector<SearchNodePtr> final_nodes;
-        // poly_id: goal1, goal2, ...
-        std::vector<std::vector<int>> end_polygons;
+        // k-th best bound for gen_final_nodes
+        KthBound kth_bound;
+
+        // The targets of this instance, and those its searches read: own,
+        // or those of another instance for a KnnBatch worker.
+        TargetSet own;
+        const TargetSet* targets = &own;
+        std::vector<int> free_gids;
+        // srt is rebuilt from rte after PENDING_MAX updates
+        int srt_updates = 0;
+        // bumped by every change of the targets
+        int targets_version = 0;
+
+        // A search with a filter only reaches the goals having all bits of
+        // the filter (0 matches every goal).
+        unsigned filter = 0;
+        int num_matching = 0;
+        bool matches(int gid) const { return (targets->goal_attrs[gid] & filter) == filter; }
+        static const int PENDING_MAX = 64;
         // <i, v>: reached ith goal with cost v
         //std::map<int, double> reached;
         std::vector<double> reached;
@@ -50,7 +102,6 @@ class TargetHeuristic {
 
         warthog::timer timer;
         double heuristic_using;
-        double angle_using;
 
         // Pre-initialised variables to use in search().
         Successor* search_successors;
@@ -75,8 +126,20 @@ class TargetHeuristic {
             fill(root_search_ids.begin(), root_search_ids.end(), 0);
         }
 
-        rs::MinHeapEntry NearestInAreaAB(double angle0, double angle1, const Point& p, double curMin=INF);
-        rs::MinHeapEntry NearestInAreaC(double angle0, double angle1, const Point& p, const Point& l, const Point& r, double curMin=INF);
+        // Targets in the wedge at apex swept counterclockwise from direction
+        // u0 to u1 (and, for the areas C and C', not on the same side of
+        // l->r as p), reached through apex at offset + |apex, t|.
+        struct Area {
+          Point apex, u0, u1;
+          double offset;
+          bool beyond;
+          Point l, r;
+        };
+        static const int AREA_NUM = 4;
+
+        // One best-first traversal over all areas: an entry is keyed by its
+        // smallest lower bound among the areas it meets.
+        void NearestInAreas(const Area* areas, double& minV, int& minArg);
 
         /*
          *   .........\.......p'......../...........
@@ -95,37 +158,39 @@ class TargetHeuristic {
 
           heuristic_call++;
           auto begint = std::chrono::steady_clock::now();
+          const rs::StaticRTree& srt = targets->srt;
 
-          auto updateRes = [&](rs::MinHeapEntry h, double dist) {
+          auto updateRes = [&](rs::StaticHeapEntry h, double dist) {
             if (h.key + dist < minV) {
-              minArg = *((int*)h.entryPtr->data);
+              minArg = h.id;
               minV = h.key + dist;
             }
           };
+          auto updatePending = [&](auto value) {
+            for (int gid: targets->pending) if (fabs(reached[gid] - INF) <= EPSILON && matches(gid)) {
+              const double v = value(targets->goals[gid]);
+              if (v < minV) {
+                minArg = gid;
+                minV = v;
+              }
+            }
+          };
 
           if (is_collinear(p, l, r)) {
-            rs::MinHeap heap;
             rs::Point P;
             if (p.distance(l) < p.distance(r))
               P = rs::Point(l.x, l.y);
             else
               P = rs::Point(r.x, r.y);
-            double D = sqrt(rs::RStarTreeUtil::minDis2(P, rte->root->mbrn));
-            heap.push(rs::MinHeapEntry(D, rte->root));
-
-            rs::MinHeapEntry res(INF, (rs::Entry_P)nullptr);
-            while (true) {
-              res = rs::RStarTreeUtil::iNearestNeighbour(heap, P);
-              if (res.key == INF) // not found
-                break;
-              int gid = *((int*)res.entryPtr->data);
-              if (fabs(reached[gid] - INF) <= EPSILON)
-                break;
-              //if (reached.find(gid) == reached.end())
-              //  break;
-            }
+            heap.clear();
+            srt.start(heap, P);
+
+            // reached targets are skipped by the overlay
+            rs::StaticHeapEntry res = srt.iNearestNeighbour(heap, P, &unreached, filter);
+            const Point near = {P.coord[0], P.coord[1]};
             if (res.key != INF)
-              updateRes(res, p.distance({P.coord[0], P.coord[1]}));
+              updateRes(res, p.distance(near));
+            updatePending([&](const Point& g) { return p.distance(near) + near.distance(g); });
 
             auto endt = std::chrono::steady_clock::now();
             heuristic_using += std::chrono::duration_cast<std::chrono::microseconds>(endt - begint).count();
@@ -133,35 +198,23 @@ class TargetHeuristic {
           }
 
           Point p2, pl, pl2, pr, pr2;
-          double pl_angle, pl2_angle, pr_angle, pr2_angle;
 
           p2 = reflect_point(p, l, r);
 
           pl = l - p, pl2 = l - p2;
           pr = r - p, pr2 = r - p2;
 
-          auto begint2 = std::chrono::steady_clock::now();
-          pl_angle = get_angle(pl, true); pl2_angle = get_angle(pl2, true);
-          pr_angle = get_angle(pr, true); pr2_angle = get_angle(pr2, true);
-          auto endt2 = std::chrono::steady_clock::now();
-          angle_using += std::chrono::duration_cast<std::chrono::microseconds>(endt2 - begint2).count();
-
-          double p2l = p.distance(l);
-          rs::MinHeapEntry res = NearestInAreaAB(pl_angle, pl2_angle, l, minV - p2l);
-          updateRes(res, p2l);
-
-          double p2r = p.distance(r);
-          res = NearestInAreaAB(pr2_angle, pr_angle, r, minV - p2r);
-          updateRes(res, p2r);
-
-          res = NearestInAreaC(pr_angle, pl_angle, p, l, r, minV);
-          updateRes(res, 0);
-
-          res = NearestInAreaC(pl2_angle, pr2_angle, p2, r, l, minV);
-          updateRes(res, 0);
+          const Area areas[AREA_NUM] = {
+            {l, pl, pl2, p.distance(l), false, l, r},  // A
+            {r, pr2, pr, p.distance(r), false, l, r},  // B
+            {p, pr, pl, 0, true, l, r},                // C
+            {p2, pl2, pr2, 0, true, r, l},             // C'
+          };
+          NearestInAreas(areas, minV, minArg);
+          updatePending([&](const Point& g) { return get_h_value(p, g, l, r); });
 
           if (minArg == -1) {
-            if ((int)final_nodes.size() != std::min(K, (int)goals.size()))
+            if ((int)final_nodes.size() != std::min(K, num_matching))
               assert(false);
           }
           auto endt = std::chrono::steady_clock::now();
@@ -170,42 +223,62 @@ class TargetHeuristic {
         }
 
         void initRtree() {
-          // rte can be initialized only once
-          if (rte != NULL) return;
+          if (rte != NULL) delete rte;
           rte = new rs::RStarTree();
           rtEntries.clear();
           gids.clear();
-          for (int i=0; i<(int)goals.size(); i++) gids.push_back(i);
+          for (int i=0; i<(int)own.goals.size(); i++) gids.push_back(i);
           for (int& i: gids) {
-            const Point& it = goals[i];
+            const Point& it = own.goals[i];
             rs::Mbr mbr(it.x, it.x, it.y, it.y);
             rs::LeafNodeEntry leaf(mbr, (rs::Data_P)(&i));
             rtEntries.push_back(leaf);
           }
 
-          for (auto& it: rtEntries)
-            rte->insertData(&it);
+          rs::Entry_P_V entryPtrs;
+          for (int i=0; i<(int)own.goals.size(); i++) if (own.alive[i])
+            entryPtrs.push_back(&rtEntries[i]);
+          rte->bulkLoad(entryPtrs);
+          rebuild_static();
+        }
+
+        void rebuild_static() {
+          own.srt.build(*rte);
+          own.srt.setMasks(own.goal_attrs);
+          own.pending.clear();
+          srt_updates = 0;
         }
 
+        // Moves gid from the end polygon it is in to poly (-1: none).
+        void set_goal_polygon(int gid, int poly);
+
         void init_search() {
             assert(node_pool);
             node_pool->reclaim();
             search_id++;
             open_list = pq();
             final_nodes = std::vector<SearchNodePtr>();
-            reached.resize(goals.size());
+            const int goal_num = targets->goals.size();
+            reached.resize(goal_num);
             fill(reached.begin(), reached.end(), INF);
+            unreached.reset(targets->srt);
+            num_matching = targets->num_targets;
+            if (filter) {
+              num_matching = 0;
+              for (int i=0; i<goal_num; i++) num_matching += targets->alive[i] && matches(i);
+            }
             nodes_generated = 0;
             nodes_pushed = 0;
             nodes_popped = 0;
             nodes_pruned_post_pop = 0;
             successor_calls = 0;
             nodes_reevaluate = 0;
-            gen_initial_nodes();
+            kth_bound.reset(K, goal_num);
+            // nothing to reach, and no heuristic for the initial nodes
+            if (num_matching > 0) gen_initial_nodes();
             heuristic_using = 0;
             heuristic_call = 0;
             heuristic_reuse = 0;
-            angle_using = 0;
         }
         void set_end_polygon();
         void gen_initial_nodes();
@@ -215,6 +288,21 @@ class TargetHeuristic {
         );
         void push_lazy(SearchNodePtr lazy);
         void print_node(SearchNodePtr node, std::ostream& outfile);
+        void free_node(SearchNodePtr node) {
+          if (distance_only) node_pool->deallocate((char*)node);
+        }
+
+        // For KnnBatch: searches read the targets of from, which must
+        // outlive them and not change while they run; set_goals or
+        // load_targets gives this instance its own again.
+        void share_targets(const TargetHeuristic& from) {
+          targets = from.targets;
+          targets_version = from.targets_version;
+        }
+
+        double get_bound() const {
+          return std::min(kth_bound.get(), start_bound);
+        }
 
     public:
         int nodes_generated;        // Nodes stored in memory
@@ -227,13 +315,18 @@ class TargetHeuristic {
         int nodes_reevaluate;
         bool verbose;
         rs::RStarTree* rte = nullptr;
-        std::vector<rs::LeafNodeEntry> rtEntries;
-        std::vector<int> gids;
+        // targets not reached yet below each slot of srt
+        rs::StaticCountOverlay unreached;
+        // reused by every heuristic call
+        rs::StaticMinHeap heap;
+        // indexed by gid; deques keep the pointers held by rte stable
+        std::deque<rs::LeafNodeEntry> rtEntries;
+        std::deque<int> gids;
 
         TargetHeuristic() { }
         TargetHeuristic(MeshPtr m) : mesh(m) { init(); }
         TargetHeuristic(int k, MeshPtr m, Point s, std::vector<Point> gs) :
-            K(k), mesh(m), start(s), goals(gs) { init(); }
+            K(k), mesh(m), start(s) { own.goals = gs; init(); }
         TargetHeuristic(TargetHeuristic const &) = delete;
         void operator=(TargetHeuristic const &x) = delete;
         ~TargetHeuristic() {
@@ -248,17 +341,59 @@ class TargetHeuristic {
 
         void set_K(int k) { this->K = k; }
 
-        void set_goals(std::vector<Point> gs) {
-          goals = std::vector<Point>(gs);
+        void set_distance_only(bool flag) { this->distance_only = flag; }
+
+        // Most search nodes held in memory at once during the last search.
+        size_t get_peak_live() { return node_pool->peak_live(); }
+
+        void set_goals(std::vector<Point> gs, std::vector<unsigned> attrs = {}) {
+          targets = &own;
+          own.goals = std::vector<Point>(gs);
+          own.goal_attrs = attrs.empty()? std::vector<unsigned>(own.goals.size(), 0): attrs;
+          assert(own.goal_attrs.size() == own.goals.size());
+          own.alive.assign(own.goals.size(), 1);
+          free_gids.clear();
+          own.num_targets = (int)own.goals.size();
           initRtree();
           set_end_polygon();
+          targets_version++;
         }
 
-        void set_start(Point s) { start = s; }
+        int get_targets_version() const { return targets_version; }
+
+        // Snapshot of the targets (see targetindex.h); load_targets replaces
+        // set_goals and fails if the file was built for another mesh.
+        bool save_targets(const std::string& path);
+        bool load_targets(const std::string& path);
+
+        // Targets can change between searches; the gid of an added target
+        // is returned (removed gids are reused), move_target keeps the gid.
+        // The fences of meshFence are not updated.
+        int add_target(const Point& g, unsigned attrs = 0);
+        void remove_target(int gid);
+        void move_target(int gid, const Point& g);
+        void set_target_attributes(int gid, unsigned attrs);
+        unsigned get_target_attributes(int gid) { return targets->goal_attrs[gid]; }
+        int get_num_targets() { return targets->num_targets; }
+
+        void set_start(Point s) {
+          start = s;
+          start_located = false;
+          start_bound = INF;
+        }
+        // The same, with where s is and an upper bound of the distance to
+        // its k-th nearest target (INF if none is known), both trusted.
+        void set_start(Point s, const PointLocation& loc, double bound) {
+          start = s;
+          start_loc = loc;
+          start_located = true;
+          start_bound = bound;
+        }
 
         void set_meshFence(KnnMeshEdgeFence* meshFence) { this->meshFence= meshFence; }
 
-        int search();
+        // only goals having all bits of the filter are searched for
+        int search(unsigned filter = 0);
 
         double get_cost(int k) {
           if (k > (int)final_nodes.size()) {
@@ -276,10 +411,6 @@ class TargetHeuristic {
           return heuristic_using;
         }
 
-        double get_angle_micro() {
-          return angle_using;
-        }
-
         void get_path_points(std::vector<Point>& out, int k);
         void print_search_nodes(std::ostream& outfile, int k);
         void deal_final_node(const SearchNodePtr node);
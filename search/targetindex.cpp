@@ -0,0 +1,255 @@
+#include "targetindex.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace polyanya
+{
+
+namespace
+{
+
+const char MAGIC[8] = {'O', 'K', 'N', 'N', 'T', 'I', 'D', 'X'};
+const uint32_t VERSION = 1;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t goal_num;
+    uint64_t mesh_hash;
+    uint32_t node_num;
+    uint32_t slot_num;
+    uint32_t payload_slot_num;
+    uint32_t mask_num;
+    int32_t max_size;
+    int32_t payloads;
+    double mbr[4];
+};
+
+size_t padded(size_t size)
+{
+    return (size + 7) & ~(size_t) 7;
+}
+
+// Writes the arrays one after the other, 8 byte aligned.
+class Writer
+{
+    std::ofstream& out;
+    public:
+        Writer(std::ofstream& o) : out(o) { }
+        template<typename T>
+        void put(const std::vector<T>& v)
+        {
+            static const char zeros[8] = {0};
+            const size_t size = v.size() * sizeof(T);
+            out.write((const char*) v.data(), size);
+            out.write(zeros, padded(size) - size);
+        }
+};
+
+// Reads the arrays back from the mapping, checking every bound.
+class Reader
+{
+    const char* data;
+    size_t size, pos;
+    public:
+        Reader(const char* d, size_t s, size_t p) : data(d), size(s), pos(p) { }
+        template<typename T>
+        bool get(std::vector<T>& v, size_t n)
+        {
+            const size_t bytes = n * sizeof(T);
+            if (bytes / sizeof(T) != n || pos + padded(bytes) > size)
+            {
+                return false;
+            }
+            v.resize(n);
+            memcpy(v.data(), data + pos, bytes);
+            pos += padded(bytes);
+            return true;
+        }
+};
+
+// Every index read by a search lies in range: nodes tile the slots in
+// order, each inner slot points to a later node one level down whose slots
+// point back up to it, leaves hold gids, and payloadSlot is the inverse.
+bool valid(const TargetIndex& index, int polygon_num)
+{
+    const int goal_num = index.goals.size();
+    for (int i = 0; i < goal_num; i++)
+    {
+        if (index.goal_poly[i] < -1 || index.goal_poly[i] >= polygon_num)
+        {
+            return false;
+        }
+    }
+    const rs::StaticRTree& t = index.tree;
+    const int node_num = t.nodes.size(), slot_num = t.child.size();
+    if ((!t.mask.empty() && (int) t.mask.size() != slot_num) ||
+        t.payloads < 0 || t.payloads > goal_num)
+    {
+        return false;
+    }
+    std::vector<int> parent(node_num, -1);
+    std::vector<char> leaf(slot_num, 0);
+    int next = 0, max_size = 0;
+    for (int n = 0; n < node_num; n++)
+    {
+        const rs::StaticNode& node = t.nodes[n];
+        if (node.first != next || node.size < 0 || node.size > slot_num - next ||
+            node.level < 0 || (n > 0 && parent[n] == -1))
+        {
+            return false;
+        }
+        next += node.size;
+        max_size = std::max(max_size, node.size);
+        for (int slot = node.first; slot < next; slot++)
+        {
+            const int c = t.child[slot];
+            if (t.up[slot] != parent[n] || t.aggregate[slot] < 0 ||
+                t.aggregate[slot] > t.payloads)
+            {
+                return false;
+            }
+            if (node.level == 0)
+            {
+                if (c < 0 || c >= goal_num)
+                {
+                    return false;
+                }
+                leaf[slot] = 1;
+            }
+            else if (c <= n || c >= node_num || parent[c] != -1 ||
+                     t.nodes[c].level != node.level - 1)
+            {
+                return false;
+            }
+            else
+            {
+                parent[c] = slot;
+            }
+        }
+    }
+    if (next != slot_num || t.maxSize != max_size)
+    {
+        return false;
+    }
+    for (int p = 0; p < (int) t.payloadSlot.size(); p++)
+    {
+        const int slot = t.payloadSlot[p];
+        if (slot != -1 && (slot < 0 || slot >= slot_num || !leaf[slot] || t.child[slot] != p))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+bool save_target_index(const std::string& path, unsigned long long mesh_hash,
+                       const TargetIndex& index)
+{
+    const rs::StaticRTree& t = index.tree;
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.goal_num = index.goals.size();
+    h.mesh_hash = mesh_hash;
+    h.node_num = t.nodes.size();
+    h.slot_num = t.child.size();
+    h.payload_slot_num = t.payloadSlot.size();
+    h.mask_num = t.mask.size();
+    h.max_size = t.maxSize;
+    h.payloads = t.payloads;
+    for (int dim = 0; dim < 2; dim++)
+    {
+        h.mbr[dim * 2] = t.mbr.coord[dim][0];
+        h.mbr[dim * 2 + 1] = t.mbr.coord[dim][1];
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        return false;
+    }
+    out.write((const char*) &h, sizeof(h));
+    Writer w(out);
+    w.put(index.goals);
+    w.put(index.goal_poly);
+    w.put(index.attrs);
+    w.put(index.alive);
+    w.put(t.nodes);
+    w.put(t.xmin);
+    w.put(t.xmax);
+    w.put(t.ymin);
+    w.put(t.ymax);
+    w.put(t.child);
+    w.put(t.aggregate);
+    w.put(t.up);
+    w.put(t.payloadSlot);
+    w.put(t.mask);
+    return (bool) out;
+}
+
+bool load_target_index(const std::string& path, unsigned long long mesh_hash,
+                       int polygon_num, TargetIndex& index)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header))
+    {
+        close(fd);
+        return false;
+    }
+    const size_t size = st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+    const char* data = (const char*) map;
+
+    Header h;
+    memcpy(&h, data, sizeof(h));
+    bool ok = memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+              h.version == VERSION && h.mesh_hash == mesh_hash;
+    if (ok)
+    {
+        rs::StaticRTree& t = index.tree;
+        Reader r(data, size, padded(sizeof(h)));
+        ok = r.get(index.goals, h.goal_num) &&
+             r.get(index.goal_poly, h.goal_num) &&
+             r.get(index.attrs, h.goal_num) &&
+             r.get(index.alive, h.goal_num) &&
+             r.get(t.nodes, h.node_num) &&
+             r.get(t.xmin, h.slot_num) &&
+             r.get(t.xmax, h.slot_num) &&
+             r.get(t.ymin, h.slot_num) &&
+             r.get(t.ymax, h.slot_num) &&
+             r.get(t.child, h.slot_num) &&
+             r.get(t.aggregate, h.slot_num) &&
+             r.get(t.up, h.slot_num) &&
+             r.get(t.payloadSlot, h.payload_slot_num) &&
+             r.get(t.mask, h.mask_num);
+        t.maxSize = h.max_size;
+        t.payloads = h.payloads;
+        t.mbr = rs::Mbr(h.mbr[0], h.mbr[1], h.mbr[2], h.mbr[3]);
+        ok = ok && valid(index, polygon_num);
+    }
+    munmap(map, size);
+    return ok;
+}
+
+}
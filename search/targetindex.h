@@ -0,0 +1,37 @@
+#pragma once
+#include "point.h"
+#include "StaticRTree.h"
+#include <string>
+#include <vector>
+
+namespace polyanya
+{
+
+namespace rs = rstar;
+
+// Target index snapshot: the goals, the polygon each goal lies in and the
+// packed R-tree over them, written once and mapped at startup instead of
+// locating the goals and bulk loading the tree again.
+//
+// The file is a fixed header followed by the arrays in the order of
+// TargetIndex, each 8 byte aligned, in the byte order of the machine that
+// wrote it.  It records the hash of the mesh it was built for; loading it
+// against another mesh, or another format version, fails.
+struct TargetIndex
+{
+    std::vector<Point> goals;
+    std::vector<int> goal_poly;      // -1 if off the mesh or removed
+    std::vector<unsigned> attrs;     // attribute bits of each goal
+    std::vector<char> alive;         // removed gids stay as holes
+    rs::StaticRTree tree;            // payloads are gids
+};
+
+bool save_target_index(const std::string& path, unsigned long long mesh_hash,
+                       const TargetIndex& index);
+// Returns false, leaving index unspecified, if the file can't be mapped,
+// is truncated, was built for another mesh, or holds a polygon (of
+// polygon_num), gid, node or slot index out of range.
+bool load_target_index(const std::string& path, unsigned long long mesh_hash,
+                       int polygon_num, TargetIndex& index);
+
+}
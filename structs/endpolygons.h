@@ -0,0 +1,129 @@
+#pragma once
+#include "consts.h"
+#include "point.h"
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+namespace polyanya {
+
+// Per-polygon target sub-index, built from end_polygons.
+// Goals of each polygon are sorted along the wider axis of their bounding
+// box, so scanning outwards from the root visits them in increasing |dx|
+// (or |dy|), which is a lower bound on their euclidean distance to the root.
+class EndPolygonIndex {
+  struct Item {
+    double key;
+    int gid;
+    bool operator<(const Item& other) const { return key < other.key; }
+  };
+
+  // goals of polygon p: items[offset[p], offset[p+1])
+  std::vector<int> offset;
+  std::vector<Item> items;
+  std::vector<char> use_y;
+
+  // Appends the goals of polygon p sorted along the wider axis of their box.
+  void sort_goals(int p, const std::vector<int>& gs, const std::vector<Point>& goals,
+                  std::vector<Item>& out) {
+    if (gs.empty()) return;
+    double min_x = INF, max_x = -INF, min_y = INF, max_y = -INF;
+    for (int gid: gs) {
+      min_x = std::min(min_x, goals[gid].x); max_x = std::max(max_x, goals[gid].x);
+      min_y = std::min(min_y, goals[gid].y); max_y = std::max(max_y, goals[gid].y);
+    }
+    use_y[p] = (max_y - min_y) > (max_x - min_x);
+    const size_t first = out.size();
+    for (int gid: gs)
+      out.push_back({use_y[p]? goals[gid].y: goals[gid].x, gid});
+    std::sort(out.begin() + first, out.end());
+  }
+
+public:
+  void build(const std::vector<std::vector<int>>& end_polygons,
+             const std::vector<Point>& goals) {
+    const int polynum = (int)end_polygons.size();
+    offset.assign(polynum+1, 0);
+    use_y.assign(polynum, 0);
+    items.clear();
+    for (int p=0; p<polynum; p++) {
+      offset[p] = (int)items.size();
+      sort_goals(p, end_polygons[p], goals, items);
+    }
+    offset[polynum] = (int)items.size();
+  }
+
+  // Re-sorts the goals of one polygon after end_polygons[poly] changed;
+  // the goals of later polygons are shifted, the others are untouched.
+  void update(int poly, const std::vector<std::vector<int>>& end_polygons,
+              const std::vector<Point>& goals) {
+    std::vector<Item> fresh;
+    sort_goals(poly, end_polygons[poly], goals, fresh);
+    const int lo = offset[poly], hi = offset[poly+1];
+    const int delta = (int)fresh.size() - (hi - lo);
+    items.erase(items.begin() + lo, items.begin() + hi);
+    items.insert(items.begin() + lo, fresh.begin(), fresh.end());
+    for (int p=poly+1; p<(int)offset.size(); p++) offset[p] += delta;
+  }
+
+  // Visits goals of `poly` whose key is within `budget` of the root, in
+  // increasing key distance; visit(gid) returns the budget for the rest
+  // of the scan, so it can shrink as better goals are found.
+  template<typename Visit>
+  void scan(int poly, const Point& root, double budget, Visit visit) const {
+    const int lo = offset[poly], hi = offset[poly+1];
+    if (lo == hi) return;
+    const double rkey = use_y[poly]? root.y: root.x;
+    int r = std::lower_bound(items.begin() + lo, items.begin() + hi, Item{rkey, -1}) - items.begin();
+    int l = r - 1;
+    while (l >= lo || r < hi) {
+      const double dl = l >= lo? rkey - items[l].key: INF;
+      const double dr = r < hi? items[r].key - rkey: INF;
+      int gid;
+      if (dl <= dr) {
+        if (dl > budget) break;
+        gid = items[l--].gid;
+      } else {
+        if (dr > budget) break;
+        gid = items[r++].gid;
+      }
+      budget = visit(gid);
+    }
+  }
+};
+
+// Upper bound of the k-th nearest goal found so far in a search.
+// Keeps the first path length generated for each distinct goal; any final
+// node with a lower bound above get() can never be popped before k goals
+// are reached, so it doesn't need to be generated.
+class KthBound {
+  int K = 1;
+  int search_id = 0;
+  std::vector<int> seen;
+  std::priority_queue<double> heap;
+
+public:
+  void reset(int k, int goal_num) {
+    K = k;
+    heap = std::priority_queue<double>();
+    if ((int)seen.size() != goal_num) {
+      seen.assign(goal_num, 0);
+      search_id = 0;
+    }
+    search_id++;
+  }
+
+  void add(int gid, double ub) {
+    if (seen[gid] == search_id) return;
+    seen[gid] = search_id;
+    if ((int)heap.size() < K) heap.push(ub);
+    else if (!heap.empty() && ub < heap.top()) {
+      heap.pop();
+      heap.push(ub);
+    }
+  }
+
+  double get() const { return heap.empty() || (int)heap.size() < K? INF: heap.top(); }
+};
+
+}
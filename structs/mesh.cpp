@@ -1,4 +1,5 @@
 #include "mesh.h"
+#include "fnv.h"
 #include <vector>
 #include <iostream>
 #include <map>
@@ -14,6 +15,7 @@ Mesh::Mesh(std::istream& infile)
 {
     read(infile);
     precalc_point_location();
+    precalc_edges();
 }
 
 void Mesh::read(std::istream& infile)
@@ -514,6 +516,60 @@ PointLocation Mesh::get_point_location_naive(Point& p)
     return {PointLocation::NOT_ON_MESH, -1, -1, -1, -1};
 }
 
+// Numbers the edges densely; an edge between two polygons gets its id from
+// the polygon with the smaller index and is looked up by the other one.
+void Mesh::precalc_edges()
+{
+    edge_num = 0;
+    edge_vertices.clear();
+    for (int i = 0; i < (int) mesh_polygons.size(); i++)
+    {
+        Polygon& p = mesh_polygons[i];
+        const int n = p.vertices.size();
+        p.edges.assign(n, -1);
+        for (int j = 0; j < n; j++)
+        {
+            const int other = p.polygons[j];
+            if (other != -1 && other < i)
+            {
+                const int a = p.vertices[j];
+                const int b = p.vertices[j ? j - 1 : n - 1];
+                p.edges[j] = get_edge(other, a, b);
+            }
+            if (p.edges[j] == -1)
+            {
+                p.edges[j] = edge_num++;
+                edge_vertices.push_back({p.vertices[j ? j - 1 : n - 1], p.vertices[j]});
+            }
+        }
+    }
+}
+
+unsigned long long Mesh::get_hash() const
+{
+    Fnv1a h;
+    const auto add_ints = [&](const std::vector<int>& v)
+    {
+        const int n = (int) v.size();
+        h.add(&n, sizeof(n));
+        h.add(v.data(), n * sizeof(int));
+    };
+    const int V = (int) mesh_vertices.size(), P = (int) mesh_polygons.size();
+    h.add(&V, sizeof(V));
+    h.add(&P, sizeof(P));
+    for (const Vertex& v : mesh_vertices)
+    {
+        h.add(&v.p.x, sizeof(double));
+        h.add(&v.p.y, sizeof(double));
+    }
+    for (const Polygon& p : mesh_polygons)
+    {
+        add_ints(p.vertices);
+        add_ints(p.polygons);
+    }
+    return h.get();
+}
+
 void Mesh::print(std::ostream& outfile)
 {
     outfile << "mesh with " << mesh_vertices.size() << " vertices, " \
@@ -207,9 +207,12 @@ class Mesh
         std::vector<Vertex> mesh_vertices;
         std::vector<Polygon> mesh_polygons;
         int max_poly_sides;
+        int edge_num;
+        std::vector<std::pair<int, int>> edge_vertices;   // end vertices of each edge
 
         void read(std::istream& infile);
         void precalc_point_location();
+        void precalc_edges();
         void print(std::ostream& outfile);
         PolyContainment poly_contains_point(int poly, Point& p);
         PointLocation get_point_location(Point& p);
@@ -222,6 +225,32 @@ class Mesh
         double get_miny() { return min_y; }
         double get_maxy() { return max_y; }
 
+        // Id of the edge of polygon poly between vertices a and b (in either
+        // order), -1 if they are not the ends of one of its edges.
+        int get_edge(int poly, int a, int b) const
+        {
+            if (poly < 0)
+            {
+                return -1;
+            }
+            const Polygon& p = mesh_polygons[poly];
+            int last = p.vertices.back();
+            for (int i = 0; i < (int) p.vertices.size(); i++)
+            {
+                const int cur = p.vertices[i];
+                if ((cur == a && last == b) || (cur == b && last == a))
+                {
+                    return p.edges[i];
+                }
+                last = cur;
+            }
+            return -1;
+        }
+
+        // FNV-1a over the vertices and polygons, identifies the mesh that
+        // precomputed data was built for.
+        unsigned long long get_hash() const;
+
 };
 
 }
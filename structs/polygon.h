@@ -9,6 +9,9 @@ struct Polygon
     // "int" here means an array index.
     std::vector<int> vertices;
     std::vector<int> polygons;
+    // edges[i] is the id of the edge between vertices[i-1] and vertices[i],
+    // shared with the polygon across it (polygons[i]).
+    std::vector<int> edges;
     bool is_one_way;
     double min_x, max_x, min_y, max_y;
 };
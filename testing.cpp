@@ -5,6 +5,8 @@
 #include "mesh.h"
 #include "geometry.h"
 #include "searchinstance.h"
+#include "parallelsearch.h"
+#include "knnbatch.h"
 #include "intervaHeuristic.h"
 #include "targetHeuristic.h"
 #include "fenceHeuristic.h"
@@ -12,6 +14,7 @@
 #include "EDBTknn.h"
 #include "park2poly.h"
 #include "knnMeshFence.h"
+#include "fenceindex.h"
 using namespace std;
 using namespace polyanya;
 
@@ -179,6 +182,523 @@ TEST_CASE("poly-bf") { // brute force polyanya
   }
 }
 
+TEST_CASE("poly-parallel") { // hash-distributed parallel polyanya
+  load_data(testfile);
+  int N = 100;
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  vector<ParallelSearchInstance*> psis;
+  for (int threads: {1, 2, 4})
+    psis.push_back(new ParallelSearchInstance(mp, threads));
+  for (Point& start: starts) {
+    for (Point& goal: pts) {
+      si->set_start_goal(start, goal);
+      bool found = si->search();
+      double cost = si->get_cost();
+      for (ParallelSearchInstance* psi: psis) {
+        psi->set_start_goal(start, goal);
+        REQUIRE(psi->search() == found);
+        if (found) {
+          REQUIRE(fabs(psi->get_cost() - cost) < EPSILON);
+          vector<Point> path;
+          psi->get_path_points(path);
+          double len = 0;
+          for (size_t i=1; i<path.size(); i++) len += path[i-1].distance(path[i]);
+          REQUIRE(fabs(len - cost) < EPSILON);
+        }
+      }
+    }
+  }
+  for (ParallelSearchInstance* psi: psis) delete psi;
+}
+
+TEST_CASE("rtree-bulk") { // STR bulk loading vs one-by-one insertion
+  load_data(testfile);
+  vector<int> ids(pts.size());
+  vector<rstar::LeafNodeEntry> entries;
+  rstar::Entry_P_V ptrs;
+  for (size_t i=0; i<pts.size(); i++) {
+    ids[i] = i;
+    entries.push_back(rstar::LeafNodeEntry(rstar::Mbr(pts[i].x, pts[i].x, pts[i].y, pts[i].y), &ids[i]));
+  }
+  for (auto& it: entries) ptrs.push_back(&it);
+  rstar::RStarTree ins, str;
+  for (auto& it: ptrs) ins.insertData(it);
+  str.bulkLoad(ptrs);
+  REQUIRE(str.root->aggregate == pts.size());
+
+  int N = 100;
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  for (Point& start: starts) {
+    rstar::Point q(start.x, start.y);
+    rstar::MinHeap hins, hstr;
+    hins.push(rstar::MinHeapEntry(0, ins.root));
+    hstr.push(rstar::MinHeapEntry(0, str.root));
+    for (size_t i=0; i<pts.size(); i++) {
+      rstar::MinHeapEntry a = rstar::RStarTreeUtil::iNearestNeighbour(hins, q);
+      rstar::MinHeapEntry b = rstar::RStarTreeUtil::iNearestNeighbour(hstr, q);
+      REQUIRE(fabs(a.key - b.key) < EPSILON);
+    }
+  }
+}
+
+TEST_CASE("rtree-static") { // flat copy of the R-tree vs the pointer tree
+  load_data(testfile);
+  vector<int> ids(pts.size());
+  vector<rstar::LeafNodeEntry> entries;
+  rstar::Entry_P_V ptrs;
+  for (size_t i=0; i<pts.size(); i++) {
+    ids[i] = i;
+    entries.push_back(rstar::LeafNodeEntry(rstar::Mbr(pts[i].x, pts[i].x, pts[i].y, pts[i].y), &ids[i]));
+  }
+  for (auto& it: entries) ptrs.push_back(&it);
+  rstar::RStarTree tree;
+  tree.bulkLoad(ptrs);
+  rstar::StaticRTree flat;
+  flat.build(tree);
+  REQUIRE(flat.child.size() == flat.nodes.size() - 1 + pts.size());
+
+  int N = 100;
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  for (Point& start: starts) {
+    rstar::Point q(start.x, start.y);
+    rstar::MinHeap heap;
+    rstar::StaticMinHeap fheap;
+    heap.push(rstar::MinHeapEntry(0, tree.root));
+    flat.start(fheap, q);
+    vector<bool> seen(pts.size(), false);
+    for (size_t i=0; i<pts.size(); i++) {
+      rstar::MinHeapEntry a = rstar::RStarTreeUtil::iNearestNeighbour(heap, q);
+      rstar::StaticHeapEntry b = flat.iNearestNeighbour(fheap, q);
+      REQUIRE(fabs(a.key - b.key) < EPSILON);
+      REQUIRE(!seen[b.id]);
+      REQUIRE(fabs(start.distance(pts[b.id]) - b.key) < EPSILON);
+      seen[b.id] = true;
+    }
+    REQUIRE(flat.iNearestNeighbour(fheap, q).key == INF);
+  }
+}
+
+TEST_CASE("rtree-overlay") { // skip removed payloads by per query counts
+  load_data(testfile);
+  vector<int> ids(pts.size());
+  vector<rstar::LeafNodeEntry> entries;
+  rstar::Entry_P_V ptrs;
+  for (size_t i=0; i<pts.size(); i++) {
+    ids[i] = i;
+    entries.push_back(rstar::LeafNodeEntry(rstar::Mbr(pts[i].x, pts[i].x, pts[i].y, pts[i].y), &ids[i]));
+  }
+  for (auto& it: entries) ptrs.push_back(&it);
+  rstar::RStarTree tree;
+  tree.bulkLoad(ptrs);
+  rstar::StaticRTree flat;
+  flat.build(tree);
+  REQUIRE(flat.payloads == (int)pts.size());
+  int total = 0;
+  for (int slot=0; slot<flat.nodes[0].size; slot++) total += flat.aggregate[slot];
+  REQUIRE(total == (int)pts.size());
+
+  int N = 100;
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  rstar::StaticCountOverlay live;
+  for (Point& start: starts) {
+    live.reset(flat);
+    vector<bool> removed(pts.size(), false);
+    int left = pts.size();
+    for (size_t i=0; i<pts.size(); i++) if (rand() % 2) {
+      live.remove(i);
+      removed[i] = true;
+      left--;
+    }
+    REQUIRE(live.remaining == left);
+    rstar::Point q(start.x, start.y);
+    rstar::StaticMinHeap heap;
+    flat.start(heap, q);
+    double last = 0;
+    for (int i=0; i<left; i++) {
+      rstar::StaticHeapEntry e = flat.iNearestNeighbour(heap, q, &live);
+      REQUIRE(e.key != INF);
+      REQUIRE(!removed[e.id]);
+      REQUIRE(e.key >= last - EPSILON);
+      last = e.key;
+    }
+    REQUIRE(flat.iNearestNeighbour(heap, q, &live).key == INF);
+  }
+}
+
+TEST_CASE("dynamic-targets") { // add/remove/move targets between searches
+  load_data(testfile);
+  int N = 300;
+  vector<Point> fresh;
+  generator::gen_points_in_traversable(oMap, polys, N, fresh);
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, 10, starts);
+
+  TargetHeuristic th(mp);
+  const int half = pts.size() / 2;
+  th.set_goals(vector<Point>(pts.begin(), pts.begin() + half));
+  map<int, Point> cur;
+  for (int i=0; i<half; i++) cur[i] = pts[i];
+
+  int next = 0;
+  for (int round=0; round<10; round++) {
+    for (int op=0; op<30; op++) {
+      const int kind = rand() % 3;
+      if (kind == 0 || cur.size() < 2) {
+        const Point& p = fresh[next++ % fresh.size()];
+        const int gid = th.add_target(p);
+        REQUIRE(cur.find(gid) == cur.end());
+        cur[gid] = p;
+      } else {
+        auto it = cur.begin();
+        advance(it, rand() % cur.size());
+        if (kind == 1) {
+          th.remove_target(it->first);
+          cur.erase(it);
+        } else {
+          const Point& p = fresh[next++ % fresh.size()];
+          th.move_target(it->first, p);
+          it->second = p;
+        }
+      }
+    }
+    REQUIRE(th.get_num_targets() == (int)cur.size());
+    REQUIRE((int)th.rte->root->aggregate == (int)cur.size());
+
+    vector<Point> goals;
+    for (auto& it: cur) goals.push_back(it.second);
+    th.set_K(goals.size());
+    ki->set_K(goals.size());
+    for (Point& start: starts) {
+      th.set_start(start);
+      ki->set_start_goal(start, goals);
+      int resth = th.search();
+      int reski = ki->search();
+      REQUIRE(resth == reski);
+      for (int i=0; i<resth; i++) {
+        REQUIRE(fabs(th.get_cost(i) - ki->get_cost(i)) < EPSILON);
+        const int gid = th.get_gid(i);
+        REQUIRE(cur.find(gid) != cur.end());
+      }
+    }
+  }
+}
+
+TEST_CASE("knn-batch") { // batched queries vs one by one
+  load_data(testfile);
+  int N = 100;
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  for (int i=0; i<20; i++) starts.push_back(starts[rand() % N]);
+  // and a few right next to others, mostly in the same polygon
+  for (int i=0; i<20; i++) starts.push_back(starts[i] + Point{EPSILON * 100, EPSILON * 100});
+  int k = min(5, (int)pts.size());
+  hi->set_goals(pts);
+  hi->set_K(k);
+
+  KnnBatch batch(mp, hi, 3);
+  for (int pass=0; pass<2; pass++) {
+    vector<KnnResult> res;
+    batch.search(starts, k, res);
+    REQUIRE(res.size() == starts.size());
+    REQUIRE(batch.get_located() > 0);
+    for (size_t q=0; q<starts.size(); q++) {
+      hi->set_start(starts[q]);
+      int reshi = hi->search();
+      REQUIRE(reshi == (int)res[q].dists.size());
+      for (int i=0; i<reshi; i++) {
+        REQUIRE(fabs(res[q].dists[i] - hi->get_cost(i)) < EPSILON);
+        REQUIRE(res[q].gids[i] == (int)hi->get_gid(i));
+      }
+      REQUIRE((res[q].duplicate || res[q].nodes_popped > 0 || reshi == 0));
+    }
+    // the second pass runs on new targets
+    hi->move_target(0, pts.back());
+  }
+}
+
+TEST_CASE("target-filter") { // k nearest targets having given attribute bits
+  load_data(testfile);
+  int N = 10;
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  vector<unsigned> attrs(pts.size());
+  for (auto& a: attrs) a = rand() % 8;
+  TargetHeuristic th(mp);
+  th.set_goals(pts, attrs);
+  // a few more after the flat tree was built, and a few changed bits
+  vector<Point> goals(pts);
+  for (int i=0; i<5; i++) {
+    goals.push_back(starts[i]);
+    attrs.push_back(rand() % 8);
+    th.add_target(starts[i], attrs.back());
+  }
+  for (int i=0; i<10; i++) {
+    int gid = rand() % pts.size();
+    attrs[gid] = rand() % 8;
+    th.set_target_attributes(gid, attrs[gid]);
+  }
+
+  unsigned filters[] = {0, 1, 2, 4, 3, 7, 8}; // no goal has bit 8
+  for (unsigned filter: filters) {
+    vector<Point> sub;
+    for (size_t i=0; i<goals.size(); i++) if ((attrs[i] & filter) == filter) sub.push_back(goals[i]);
+    int k = min(5, (int)sub.size());
+    th.set_K(k);
+    ki->set_K(k);
+    for (Point& start: starts) {
+      th.set_start(start);
+      int resth = th.search(filter);
+      if (sub.empty()) {
+        REQUIRE(resth == 0);
+        continue;
+      }
+      ki->set_start_goal(start, sub);
+      int reski = ki->search();
+      REQUIRE(resth == reski);
+      for (int i=0; i<resth; i++) {
+        REQUIRE(fabs(th.get_cost(i) - ki->get_cost(i)) < EPSILON);
+        REQUIRE((attrs[th.get_gid(i)] & filter) == filter);
+      }
+    }
+  }
+}
+
+TEST_CASE("target-index") { // save and map target index snapshots
+  load_data(testfile);
+  int N = 10;
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  int k = min(5, (int)pts.size());
+  const string path = "target-index.bin";
+
+  TargetHeuristic th(mp);
+  th.set_goals(pts);
+  th.remove_target(0);
+  th.add_target(starts[0], 1);
+  REQUIRE(th.save_targets(path));
+  TargetHeuristic loaded(mp);
+  REQUIRE(loaded.load_targets(path));
+  REQUIRE(loaded.get_num_targets() == th.get_num_targets());
+  th.set_K(k);
+  loaded.set_K(k);
+  for (Point& start: starts) {
+    th.set_start(start);
+    loaded.set_start(start);
+    int resth = th.search();
+    REQUIRE(loaded.search() == resth);
+    for (int i=0; i<resth; i++) {
+      REQUIRE(fabs(loaded.get_cost(i) - th.get_cost(i)) < EPSILON);
+      REQUIRE(loaded.get_gid(i) == th.get_gid(i));
+    }
+  }
+  // updates after loading build the pointer tree
+  loaded.move_target(1, starts[1]);
+  th.move_target(1, starts[1]);
+  loaded.set_start(starts[2]);
+  th.set_start(starts[2]);
+  REQUIRE(loaded.search() == th.search());
+  REQUIRE(fabs(loaded.get_cost(0) - th.get_cost(0)) < EPSILON);
+
+  // IER queries on a snapshot it wrote
+  ffp->set_goals(pts);
+  ffp->set_K(k);
+  REQUIRE(ffp->save_targets(path));
+  IERPolyanya ier(si);
+  REQUIRE(ier.load_targets(path));
+  ier.set_K(k);
+  for (Point& start: starts) {
+    ffp->set_start(start);
+    ier.set_start(start);
+    vector<double> d0 = ffp->search(), d1 = ier.search();
+    REQUIRE(d0.size() == d1.size());
+    for (size_t i=0; i<d0.size(); i++) REQUIRE(fabs(d0[i] - d1[i]) < EPSILON);
+  }
+  // its goals have no attributes, until they are set
+  REQUIRE(loaded.load_targets(path));
+  loaded.set_start(starts[0]);
+  REQUIRE(loaded.search(1) == 0);
+  loaded.set_target_attributes(2, 1);
+  REQUIRE(loaded.search(1) == 1);
+  REQUIRE(loaded.get_gid(0) == 2);
+
+  // wrong mesh, corrupt files
+  TargetIndex index;
+  const int polygon_num = mp->mesh_polygons.size();
+  REQUIRE(load_target_index(path, mp->get_hash(), polygon_num, index));
+  REQUIRE(!load_target_index(path, mp->get_hash() + 1, polygon_num, index));
+  REQUIRE(!load_target_index("no-such-file.bin", mp->get_hash(), polygon_num, index));
+  // a valid header over indices out of range
+  const TargetIndex good = index;
+  const auto rejects = [&](auto corrupt) {
+    TargetIndex bad = good;
+    corrupt(bad);
+    REQUIRE(save_target_index(path, mp->get_hash(), bad));
+    REQUIRE(!load_target_index(path, mp->get_hash(), polygon_num, index));
+  };
+  rejects([&](TargetIndex& t) { t.goal_poly[0] = polygon_num; });
+  rejects([&](TargetIndex& t) { t.tree.child[0] = -1; });
+  rejects([&](TargetIndex& t) { t.tree.child.back() = t.goals.size(); });
+  rejects([&](TargetIndex& t) { t.tree.up.back() = t.tree.child.size(); });
+  rejects([&](TargetIndex& t) { t.tree.payloadSlot[1] = t.tree.child.size(); });
+  rejects([&](TargetIndex& t) { t.tree.nodes[0].size++; });
+  rejects([&](TargetIndex& t) { t.tree.maxSize--; });
+  {
+    ofstream trunc(path, ios::binary | ios::trunc);
+    trunc << "OKNNTIDX";
+  }
+  REQUIRE(!loaded.load_targets(path));
+  remove(path.c_str());
+}
+
+TEST_CASE("rtree-kernel") { // batch minDis2/maxDis2 kernels vs RStarTreeUtil
+  load_data(testfile);
+  vector<int> ids(pts.size());
+  vector<rstar::LeafNodeEntry> entries;
+  rstar::Entry_P_V ptrs;
+  for (size_t i=0; i<pts.size(); i++) {
+    ids[i] = i;
+    entries.push_back(rstar::LeafNodeEntry(rstar::Mbr(pts[i].x, pts[i].x, pts[i].y, pts[i].y), &ids[i]));
+  }
+  for (auto& it: entries) ptrs.push_back(&it);
+  rstar::RStarTree tree;
+  tree.bulkLoad(ptrs);
+  rstar::StaticRTree flat;
+  flat.build(tree);
+
+  int N = 100;
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  vector<double> mind(flat.maxSize), maxd(flat.maxSize);
+  for (bool simd: {false, true}) {
+    rstar::StaticRTree::useSimd(simd);
+    for (Point& start: starts) {
+      rstar::Point q(start.x, start.y);
+      for (const rstar::StaticNode& node: flat.nodes) {
+        flat.minDis2(q, node, mind.data());
+        flat.maxDis2(q, node, maxd.data());
+        for (int i=0; i<node.size; i++) {
+          rstar::Mbr mbr = flat.slotMbr(node.first + i);
+          REQUIRE(fabs(mind[i] - rstar::RStarTreeUtil::minDis2(q, mbr)) < EPSILON);
+          REQUIRE(fabs(maxd[i] - rstar::RStarTreeUtil::maxDis2(q, mbr)) < EPSILON);
+        }
+      }
+    }
+  }
+  rstar::StaticRTree::useSimd(true);
+}
+
+TEST_CASE("wedge") { // cross product wedge predicate vs angles
+  load_data(testfile);
+  int N = 30;
+  vector<Point> ps;
+  generator::gen_points_in_traversable(oMap, polys, N, ps);
+  auto angle_in_wedge = [&](const Point& v, const Point& u0, const Point& u1, bool& near) {
+    double diff = get_angle(u1, true) - get_angle(u0, true);
+    if (diff < 0) diff += 360.0;
+    double av = get_angle(v, true) - get_angle(u0, true);
+    if (av < 0) av += 360.0;
+    near = fabs(av) < 1e-6 || fabs(av - diff) < 1e-6 || fabs(av - 360) < 1e-6;
+    return av <= diff;
+  };
+  for (const Point& a: ps) for (const Point& b: ps) for (const Point& c: ps) {
+    if (a == b || a == c) continue;
+    const Point u0 = b - a, u1 = c - a;
+    for (const Point& v: pts) {
+      bool near;
+      bool expected = angle_in_wedge(v - a, u0, u1, near);
+      if (!near) REQUIRE(in_wedge(v - a, u0, u1) == expected);
+      if (expected) REQUIRE(in_wedge(v - a, u0, u1));
+    }
+  }
+}
+
+TEST_CASE("orient-kernel") { // mask kernels in get_successors vs binary search
+  load_data(testfile);
+  int N = 10;
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  const OrientKernel kernels[] = {
+    OrientKernel::SCALAR, OrientKernel::SSE2, OrientKernel::AVX2
+  };
+  for (Point& start: starts) {
+    set_orient_kernel(OrientKernel::BINARY_SEARCH);
+    ki->set_K(pts.size());
+    ki->set_start_goal(start, pts);
+    int res0 = ki->search();
+    int gen0 = ki->nodes_generated;
+    vector<double> dists0;
+    for (int i=0; i<res0; i++) dists0.push_back(ki->get_cost(i));
+
+    for (OrientKernel kernel: kernels) {
+      set_orient_kernel(kernel);
+      int res = ki->search();
+      REQUIRE(res == res0);
+      REQUIRE(ki->nodes_generated == gen0);
+      for (int i=0; i<res; i++) {
+        REQUIRE(fabs(ki->get_cost(i) - dists0[i]) < EPSILON);
+      }
+    }
+  }
+  set_orient_kernel(OrientKernel::AUTO);
+}
+
+TEST_CASE("distance-only") { // recycle nodes when paths are not needed
+  load_data(testfile);
+  int N = 100;
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+
+  meshFence->set_goals(pts);
+  meshFence->floodfill();
+  hi->set_goals(pts);
+  fi->set_goals(pts);
+  int k = min(5, (int)pts.size());
+  for (Point& start: starts) {
+    ki->set_K(k);
+    ki->set_start_goal(start, pts);
+    hi->set_K(k);
+    hi->set_start(start);
+    fi->set_K(k);
+    fi->set_start(start);
+
+    ki->set_distance_only(false);
+    hi->set_distance_only(false);
+    fi->set_distance_only(false);
+    int reski = ki->search();
+    vector<double> dki;
+    for (int i=0; i<reski; i++) dki.push_back(ki->get_cost(i));
+    int reshi = hi->search();
+    vector<double> dhi;
+    for (int i=0; i<reshi; i++) dhi.push_back(hi->get_cost(i));
+    int resfi = fi->search();
+    vector<double> dfi;
+    for (int i=0; i<resfi; i++) dfi.push_back(fi->get_cost(i));
+    size_t live_ki = ki->get_peak_live();
+    size_t live_hi = hi->get_peak_live();
+    size_t live_fi = fi->get_peak_live();
+
+    ki->set_distance_only(true);
+    hi->set_distance_only(true);
+    fi->set_distance_only(true);
+    REQUIRE(ki->search() == reski);
+    REQUIRE(hi->search() == reshi);
+    REQUIRE(fi->search() == resfi);
+    for (int i=0; i<reski; i++) REQUIRE(fabs(ki->get_cost(i) - dki[i]) < EPSILON);
+    for (int i=0; i<reshi; i++) REQUIRE(fabs(hi->get_cost(i) - dhi[i]) < EPSILON);
+    for (int i=0; i<resfi; i++) REQUIRE(fabs(fi->get_cost(i) - dfi[i]) < EPSILON);
+    REQUIRE(ki->get_peak_live() <= live_ki);
+    REQUIRE(hi->get_peak_live() <= live_hi);
+    REQUIRE(fi->get_peak_live() <= live_fi);
+  }
+  ki->set_distance_only(false);
+  hi->set_distance_only(false);
+  fi->set_distance_only(false);
+}
+
 TEST_CASE("fence-nn") { // Fence preprocessing for NN query
   load_data(testfile);
   int N = 1000;
@@ -193,11 +713,12 @@ TEST_CASE("fence-nn") { // Fence preprocessing for NN query
     fi->set_start(start);
     hi->set_start(start);
     double nn_cost = 0.0;
-    pair<int, double> res = fi->nn_query(si, nn_cost); 
+    pair<int, double> res = fi->nn_query(nn_cost);
     int rest_hi = hi->search();
     if (rest_hi) {
       double dist_hi = hi->get_cost(0);
       REQUIRE(fabs(res.second - dist_hi) <= EPSILON);
+      REQUIRE(res.first != -1);
     } else {
       REQUIRE(res.first == -1);
     }
@@ -247,6 +768,391 @@ TEST_CASE("fence-h") { // Fence preoprocessing for kNN
 }
 
 
+TEST_CASE("fence-parallel") { // floodfill split over threads
+  load_data(testfile);
+  int N = 200;
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  int k = min(5, (int)pts.size());
+  hi->set_goals(pts);
+  hi->set_K(k);
+  fi->set_K(k);
+  for (int threads: {2, 3, 8}) {
+    meshFence->set_goals(pts);
+    meshFence->floodfill(threads);
+    int total = 0;
+    for (int e=0; e<meshFence->get_edge_num(); e++) {
+      for (const Fence& f: meshFence->get_fences(e)) {
+        REQUIRE(f.gid >= 0);
+        REQUIRE(f.gid < (int)pts.size());
+        total++;
+      }
+    }
+    REQUIRE(total == meshFence->fenceCnt);
+    for (Point& start: starts) {
+      hi->set_start(start);
+      fi->set_start(start);
+      fi->set_goals(pts);
+      int resthi = hi->search();
+      int restfi = fi->search();
+      REQUIRE(resthi == restfi);
+      for (int i=0; i<resthi; i++) {
+        REQUIRE(fabs(hi->get_cost(i) - fi->get_cost(i)) < EPSILON);
+      }
+    }
+  }
+}
+
+TEST_CASE("fence-update") { // add / remove goals with local fence repair
+  load_data(testfile);
+  int N = 50;
+  vector<Point> starts, added;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  generator::gen_points_in_traversable(oMap, polys, 10, added);
+  int k = min(5, (int)pts.size());
+  vector<Point> goals = pts;
+  meshFence->set_goals(goals);
+  meshFence->floodfill();
+
+  const auto check = [&]() {
+    hi->set_goals(goals);
+    hi->set_K(k);
+    fi->set_goals(goals);
+    fi->set_K(k);
+    for (Point& start: starts) {
+      hi->set_start(start);
+      fi->set_start(start);
+      int resthi = hi->search();
+      int restfi = fi->search();
+      REQUIRE(resthi == restfi);
+      for (int i=0; i<resthi; i++) {
+        REQUIRE(fabs(hi->get_cost(i) - fi->get_cost(i)) < EPSILON);
+      }
+    }
+  };
+  for (Point& p: added) {
+    int gid = meshFence->add_goal(p);
+    REQUIRE(gid == (int)goals.size());
+    goals.push_back(p);
+    check();
+  }
+  // removed goals are moved off the mesh, so the queries keep the gids
+  const Point off = {-1e9, -1e9};
+  for (int gid: {0, 7, (int)goals.size() - 1, 3, 42}) {
+    if (gid >= (int)goals.size()) continue;
+    meshFence->remove_goal(gid);
+    goals[gid] = off;
+    check();
+    for (int e=0; e<meshFence->get_edge_num(); e++)
+      for (const Fence& f: meshFence->get_fences(e)) REQUIRE(f.gid != gid);
+  }
+  int gid = meshFence->add_goal(added[0]);
+  goals.push_back(added[0]);
+  REQUIRE(gid + 1 == (int)goals.size());
+  check();
+}
+
+TEST_CASE("fence-index") { // fence index file written and mapped again
+  load_data(testfile);
+  const string path = "/tmp/oknn-test-fences.bin";
+  meshFence->set_goals(pts);
+  meshFence->floodfill();
+  REQUIRE(meshFence->save_fences(path));
+
+  KnnMeshEdgeFence loaded(mp);
+  vector<char> alive(pts.size(), 1);
+  REQUIRE(!loaded.load_fences(path, hash_goals(pts, vector<char>(pts.size(), 0))));
+  REQUIRE(loaded.load_fences(path, hash_goals(pts, alive)));
+  REQUIRE(loaded.get_goals() == pts);
+  REQUIRE(loaded.fenceCnt == meshFence->fenceCnt);
+  REQUIRE(loaded.get_active_edge_cnt() == meshFence->get_active_edge_cnt());
+  for (int e=0; e<mp->edge_num; e++) {
+    FenceRange a = meshFence->get_fences(e), b = loaded.get_fences(e);
+    REQUIRE(a.size() == b.size());
+    for (int i=0; i<a.size(); i++) {
+      REQUIRE(a[i].gid == b[i].gid);
+      REQUIRE(a[i].root == b[i].root);
+      REQUIRE(a[i].g == b[i].g);
+      REQUIRE(a[i].lb == b[i].lb);
+    }
+  }
+
+  // queries answered from the mapping, and an update on top of it
+  int N = 100, k = min(5, (int)pts.size());
+  vector<Point> starts, added;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  generator::gen_points_in_traversable(oMap, polys, 1, added);
+  vector<Point> goals = pts;
+  REQUIRE(loaded.add_goal(added[0]) == (int)goals.size());
+  goals.push_back(added[0]);
+  fi->set_meshFence(&loaded);
+  fi->set_goals(goals);
+  fi->set_K(k);
+  hi->set_goals(goals);
+  hi->set_K(k);
+  for (Point& start: starts) {
+    hi->set_start(start);
+    fi->set_start(start);
+    int resthi = hi->search();
+    int restfi = fi->search();
+    REQUIRE(resthi == restfi);
+    for (int i=0; i<resthi; i++) REQUIRE(fabs(hi->get_cost(i) - fi->get_cost(i)) < EPSILON);
+  }
+  fi->set_meshFence(meshFence);
+
+  // fences with a gid or root out of range are rejected; the last fence
+  // ends the file
+  {
+    ifstream in(path, ios::binary);
+    const string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    const size_t last = data.size() - sizeof(Fence);
+    const int bad[][2] = {{(int)pts.size(), -1}, {0, (int)mp->mesh_vertices.size()}};
+    for (const auto& it: bad) {
+      Fence f;
+      memcpy(&f, data.data() + last, sizeof(Fence));
+      f.gid = it[0];
+      f.root = it[1];
+      string corrupt = data;
+      memcpy(&corrupt[last], &f, sizeof(Fence));
+      ofstream out(path, ios::binary | ios::trunc);
+      out.write(corrupt.data(), corrupt.size());
+      out.close();
+      KnnMeshEdgeFence rejected(mp);
+      REQUIRE(!rejected.load_fences(path));
+    }
+    ofstream out(path, ios::binary | ios::trunc);
+    out.write(data.data(), data.size());
+  }
+
+  // truncated files are rejected
+  {
+    ifstream in(path, ios::binary);
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    ofstream out(path, ios::binary | ios::trunc);
+    out.write(data.data(), data.size() / 2);
+  }
+  KnnMeshEdgeFence truncated(mp);
+  REQUIRE(!truncated.load_fences(path));
+  remove(path.c_str());
+}
+
+TEST_CASE("fence-budget") { // at most a few fences per edge, still exact
+  load_data(testfile);
+  int N = 200, k = min(5, (int)pts.size());
+  vector<Point> starts, added;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  generator::gen_points_in_traversable(oMap, polys, 3, added);
+  for (int budget: {1, 2}) {
+    vector<Point> goals = pts;
+    meshFence->set_goals(goals);
+    meshFence->set_fence_budget(budget);
+    meshFence->floodfill();
+    for (Point& p: added) {
+      meshFence->add_goal(p);
+      goals.push_back(p);
+    }
+    int capped = 0;
+    for (int e=0; e<meshFence->get_edge_num(); e++) {
+      REQUIRE(meshFence->get_fence_num(e) <= budget);
+      capped += meshFence->get_rest_lb(e) < INF;
+    }
+    REQUIRE(capped >= meshFence->capped_edges);
+    hi->set_goals(goals);
+    hi->set_K(k);
+    fi->set_goals(goals);
+    fi->set_K(k);
+    for (Point& start: starts) {
+      hi->set_start(start);
+      fi->set_start(start);
+      int resthi = hi->search();
+      int restfi = fi->search();
+      REQUIRE(resthi == restfi);
+      for (int i=0; i<resthi; i++) REQUIRE(fabs(hi->get_cost(i) - fi->get_cost(i)) < EPSILON);
+    }
+  }
+  meshFence->set_fence_budget(0);
+}
+
+TEST_CASE("fence-lazy") { // regions built on demand and evicted, still exact
+  load_data(testfile);
+  int N = 100, k = min(5, (int)pts.size());
+  vector<Point> starts;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  hi->set_goals(pts);
+  hi->set_K(k);
+  fi->set_goals(pts);
+  fi->set_K(k);
+  for (size_t capacity: {(size_t)0, (size_t)1000000}) {
+    meshFence->set_lazy(4, capacity, 4);
+    meshFence->set_goals(pts);
+    meshFence->lazy_built = meshFence->lazy_evicted = 0;
+    // the first pass meets cold regions, the second mostly warm ones
+    for (int pass=0; pass<2; pass++) {
+      for (Point& start: starts) {
+        hi->set_start(start);
+        fi->set_start(start);
+        int resthi = hi->search();
+        int restfi = fi->search();
+        REQUIRE(resthi == restfi);
+        for (int i=0; i<resthi; i++) REQUIRE(fabs(hi->get_cost(i) - fi->get_cost(i)) < EPSILON);
+      }
+    }
+    REQUIRE(meshFence->lazy_built > 0);
+    if (capacity == 0) REQUIRE(meshFence->lazy_evicted > 0);
+    else REQUIRE(meshFence->lazy_evicted == 0);
+  }
+  meshFence->set_lazy(0, 0);
+}
+
+TEST_CASE("fence-depth") { // fences of the d nearest goals per edge, kNN for k <= d
+  load_data(testfile);
+  int N = 100;
+  vector<Point> starts, added;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  generator::gen_points_in_traversable(oMap, polys, 1, added);
+  vector<Point> goals = pts;
+  goals.push_back(added[0]);
+  hi->set_goals(goals);
+  fi->set_goals(goals);
+  int last_cnt = 0;
+  for (int depth: {1, 3, 8}) {
+    meshFence->set_goals(pts);
+    meshFence->set_fence_depth(depth);
+    meshFence->floodfill(2);
+    REQUIRE(meshFence->fenceCnt >= last_cnt);
+    last_cnt = meshFence->fenceCnt;
+    meshFence->add_goal(added[0]);
+    for (int k: {1, 3, 8}) {
+      k = min(k, (int)goals.size());
+      hi->set_K(k);
+      fi->set_K(k);
+      for (Point& start: starts) {
+        hi->set_start(start);
+        fi->set_start(start);
+        int resthi = hi->search();
+        int restfi = fi->search();
+        REQUIRE(resthi == restfi);
+        for (int i=0; i<resthi; i++) REQUIRE(fabs(hi->get_cost(i) - fi->get_cost(i)) < EPSILON);
+      }
+    }
+  }
+  meshFence->set_fence_depth(1);
+}
+
+TEST_CASE("fence-hierarchy") { // coarse bounds over clusters, fences near the goals only
+  load_data(testfile);
+  int N = 50;
+  vector<Point> starts, added;
+  generator::gen_points_in_traversable(oMap, polys, N, starts);
+  generator::gen_points_in_traversable(oMap, polys, 2, added);
+  double minx = INF, maxx = -INF, miny = INF, maxy = -INF;
+  for (const Vertex& v: mp->mesh_vertices) {
+    minx = min(minx, v.p.x); maxx = max(maxx, v.p.x);
+    miny = min(miny, v.p.y); maxy = max(maxy, v.p.y);
+  }
+  const double diag = Point{minx, miny}.distance(Point{maxx, maxy});
+  vector<Point> goals;
+  const auto check = [&](KnnMeshEdgeFence* fence) {
+    fi->set_meshFence(fence);
+    hi->set_goals(goals);
+    fi->set_goals(goals);
+    for (int k: {1, 5}) {
+      hi->set_K(k);
+      fi->set_K(k);
+      for (Point& start: starts) {
+        hi->set_start(start);
+        fi->set_start(start);
+        int resthi = hi->search();
+        int restfi = fi->search();
+        REQUIRE(resthi == restfi);
+        for (int i=0; i<resthi; i++) REQUIRE(fabs(hi->get_cost(i) - fi->get_cost(i)) < EPSILON);
+      }
+    }
+    fi->set_meshFence(meshFence);
+  };
+  meshFence->set_goals(pts);
+  meshFence->floodfill();
+  const int full = meshFence->fenceCnt;
+  for (int size: {1, 8, 64}) {
+    for (double bound: {0.0, 0.05 * diag, INF}) {
+      goals = pts;
+      meshFence->set_hierarchy(size, bound);
+      meshFence->set_goals(goals);
+      meshFence->floodfill(size == 8? 2: 1);
+      REQUIRE(meshFence->has_coarse());
+      REQUIRE(meshFence->get_cluster_num() <= (int)mp->mesh_polygons.size());
+      if (bound == 0) REQUIRE(meshFence->fenceCnt < full);
+      check(meshFence);
+      meshFence->add_goal(added[0]);
+      goals.push_back(added[0]);
+      check(meshFence);
+      meshFence->remove_goal(0);
+      goals[0] = Point{-1e9, -1e9};
+      check(meshFence);
+    }
+  }
+  // the bound comes with a fence index, the coarse level is built again
+  goals = pts;
+  meshFence->set_hierarchy(8, 0.05 * diag);
+  meshFence->set_goals(goals);
+  meshFence->floodfill();
+  const string path = "/tmp/oknn-test-hierarchy.bin";
+  REQUIRE(meshFence->save_fences(path));
+  KnnMeshEdgeFence loaded(mp);
+  REQUIRE(loaded.load_fences(path));
+  REQUIRE(!loaded.has_coarse());
+  check(&loaded);
+  loaded.set_hierarchy(8, 0.05 * diag);
+  REQUIRE(loaded.load_fences(path));
+  REQUIRE(loaded.has_coarse());
+  check(&loaded);
+  remove(path.c_str());
+  meshFence->set_hierarchy(0, INF);
+}
+
+TEST_CASE("mesh-edges") { // dense edge ids and the fences stored by edge
+  load_data(testfile);
+  vector<int> uses(mp->edge_num, 0);
+  for (int i=0; i<(int)mp->mesh_polygons.size(); i++) {
+    const Polygon& p = mp->mesh_polygons[i];
+    int n = p.vertices.size();
+    for (int j=0; j<n; j++) {
+      int e = p.edges[j];
+      REQUIRE(e >= 0);
+      REQUIRE(e < mp->edge_num);
+      uses[e]++;
+      int a = p.vertices[j], b = p.vertices[j? j-1: n-1];
+      REQUIRE(mp->get_edge(i, b, a) == e);
+      const pair<int, int>& ends = mp->edge_vertices[e];
+      REQUIRE(min(ends.first, ends.second) == min(a, b));
+      REQUIRE(max(ends.first, ends.second) == max(a, b));
+      if (p.polygons[j] != -1)
+        REQUIRE(mp->get_edge(p.polygons[j], a, b) == e);
+    }
+  }
+  for (int e=0; e<mp->edge_num; e++) {
+    REQUIRE(uses[e] >= 1);
+    REQUIRE(uses[e] <= 2);
+  }
+
+  meshFence->set_goals(pts);
+  meshFence->floodfill();
+  int total = 0, active = 0;
+  for (int e=0; e<meshFence->get_edge_num(); e++) {
+    int num = meshFence->get_fence_num(e);
+    total += num;
+    active += num > 0;
+    for (const Fence& f: meshFence->get_fences(e)) {
+      REQUIRE(f.gid >= 0);
+      REQUIRE(f.gid < (int)pts.size());
+      REQUIRE(f.left >= -EPSILON);
+      REQUIRE(f.right <= 1 + EPSILON);
+    }
+  }
+  REQUIRE(total == meshFence->fenceCnt);
+  REQUIRE(active == meshFence->get_active_edge_cnt());
+}
+
 TEST_CASE("fast-filter") { // test fast filter in EDBT paper
   load_data(testfile);
   int N = 10;
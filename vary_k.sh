@@ -7,3 +7,7 @@ eval $cmd
 cmd="./bin/experiment dense _ < inputs/9000-cluster.in > outputs/cluster/9000-cluster.log"
 echo $cmd
 eval $cmd
+
+cmd="./bin/experiment fencek 50 1000 < ./inputs/${map}.in > ./outputs/k/${map}-fencek.log"
+echo $cmd
+eval $cmd